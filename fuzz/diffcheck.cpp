@@ -0,0 +1,158 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "diffcheck.h"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include "parser.h"
+
+using namespace std;
+
+// a type without a built-in handler, to cover registered handlers as well
+const static int CALLBACK_TYPE = 0x12;
+
+// blocks are mostly small, like serial reads, and sometimes whole reads
+const static size_t SMALL_BLOCK = 16;
+const static size_t LARGE_BLOCK = 8192;
+
+/*!
+ * Everything a parser decoded
+ */
+struct decoded {
+    string out;
+    string err;
+    string unknown;
+    string map;
+    parser::memory_usage usage;
+};
+
+/*!
+ * Records a message of CALLBACK_TYPE
+ */
+static void recordMessage(int type, const unsigned char *msg, size_t len, void *ctx) {
+    ostream& out = *static_cast<ostream *>(ctx);
+    out << "(callback 0x" << hex << type << dec << ", " << len << " bytes)";
+    out.write(reinterpret_cast<const char *>(msg), len);
+}
+
+/*!
+ * @return a message that ends any garbage left in a parser, so what was
+ * left over is compared too
+ */
+static const string& trailer() {
+    static string msg;
+    if (msg.empty()) {
+        msg.assign(reinterpret_cast<const char *>(packet::HEADER), packet::HEADER_LENGTH);
+        msg.resize(packet::odom::min_length - packet::FOOTER_LENGTH, '\0');
+        msg[packet::header::type::offset] = packet::odom::id;
+        msg.append(reinterpret_cast<const char *>(packet::FOOTER), packet::FOOTER_LENGTH);
+    }
+    return msg;
+}
+
+/*!
+ * Parses the input and collects what was decoded
+ * @param data the input
+ * @param len length of the input
+ * @param seed picks the block sizes, 0 to go a byte at a time
+ * @param result filled with what was decoded
+ */
+static void parse(const unsigned char *data, size_t len, uint32_t seed, decoded& result) {
+    ostringstream out, err;
+    streambuf *cerrbuf = cerr.rdbuf(err.rdbuf());
+
+    {
+        parser p("difftest");
+        p.setOutput(out);
+        p.setVerbosity(parser::VERB_DEBUG | parser::VERB_TEXT | parser::VERB_LASER
+                | parser::VERB_MAP | parser::VERB_ODOM | parser::VERB_UNKNOWN);
+        p.setRetention(1);
+        p.registerHandler(CALLBACK_TYPE, recordMessage, &out);
+
+        const char *in = reinterpret_cast<const char *>(data);
+        if (seed == 0) {
+            for (size_t i = 0; i < len; i++) {
+                p.update(in[i]);
+            }
+            for (size_t i = 0; i < trailer().size(); i++) {
+                p.update(trailer()[i]);
+            }
+        } else {
+            // xorshift32
+            uint32_t x = seed;
+            size_t pos = 0;
+            while (pos < len) {
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                size_t block = 1 + ((x & 0x100) ? x % LARGE_BLOCK : x % SMALL_BLOCK);
+                block = min(block, len - pos);
+                p.update(in + pos, block);
+                pos += block;
+            }
+            p.update(trailer().data(), trailer().size());
+        }
+
+        ostringstream unknown;
+        p.writeUnknown(unknown);
+        result.unknown = unknown.str();
+
+        result.map.resize(mapcache::WIDTH * mapcache::HEIGHT);
+        p.getMap().snapshot(reinterpret_cast<unsigned char *>(&result.map[0]));
+        result.usage = p.memoryUsage();
+    }
+
+    cerr.rdbuf(cerrbuf);
+    result.out = out.str();
+    result.err = err.str();
+}
+
+/*!
+ * Describes where two strings first differ
+ */
+static string firstDifference(const string& a, const string& b) {
+    size_t i = mismatch(a.begin(), a.begin() + min(a.size(), b.size()), b.begin()).first - a.begin();
+    size_t from = i > 40 ? i - 40 : 0;
+    ostringstream why;
+    why << "at byte " << i << ":\n\treference: " << a.substr(from, 80)
+        << "\n\tblock:     " << b.substr(from, 80);
+    return why.str();
+}
+
+bool diffParse(const unsigned char *data, size_t len, uint32_t seed, string& why) {
+    decoded ref, block;
+    parse(data, len, 0, ref);
+    parse(data, len, seed ? seed : 1, block);
+
+    if (ref.out != block.out) {
+        why = "decoded output differs " + firstDifference(ref.out, block.out);
+    } else if (ref.err != block.err) {
+        why = "errors differ " + firstDifference(ref.err, block.err);
+    } else if (ref.unknown != block.unknown) {
+        why = "unknown messages differ " + firstDifference(ref.unknown, block.unknown);
+    } else if (ref.map != block.map) {
+        why = "maps differ";
+    } else if (ref.usage.resyncs != block.usage.resyncs
+            || ref.usage.map_frames != block.usage.map_frames
+            || ref.usage.laser_frames != block.usage.laser_frames) {
+        why = "memory usage differs";
+    } else {
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,45 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DIFFCHECK_H_
+#define DIFFCHECK_H_
+
+#include <string>
+#include <inttypes.h>
+#include <stddef.h>
+
+using std::string;
+
+/*
+ * Differential check of the parser: the same input goes to one parser a byte
+ * at a time through update(char), the reference, and to another in blocks of
+ * pseudo-random sizes through update(const char *, size_t). Everything the two
+ * decode is captured with every verbosity flag set, along with their error
+ * messages, memory usage, unknown message summaries and maps, and compared.
+ */
+
+/*!
+ * Runs the check
+ * @param data the input
+ * @param len length of the input
+ * @param seed picks the block sizes
+ * @param why set to what differed, if anything
+ * @return true if both parsers decoded the same
+ */
+bool diffParse(const unsigned char *data, size_t len, uint32_t seed, string& why);
+
+#endif /* DIFFCHECK_H_ */
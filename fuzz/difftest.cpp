@@ -0,0 +1,244 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Differential tester for the parser, built with make difftest:
+ *
+ *     bin/difftest [-n mutations] [-s seed] [file ...]
+ *
+ * Runs diffParse over each file (the example captures by default) as it is,
+ * then over mutated copies of it: bytes flipped, inserted, deleted or
+ * repeated, headers and footers dropped in, length, index and address fields
+ * overwritten and the input cut short. Inputs the parsers disagree on are
+ * saved to difftest-failure-N.bin for replaying with -f or the fuzz target.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+#include "diffcheck.h"
+#include "packet.h"
+
+using namespace std;
+
+const static char *DEFAULT_FILES[] = {
+    "example/Packet Mode Bathroom1 09-03-2011.txt",
+    "example/Packet Mode Bathroom2(charger) 09-03-2011.txt",
+    "example/Packet Mode capture 09-03-2011.txt",
+};
+
+// block size seeds tried on every unmutated input
+const static uint32_t SEEDS = 4;
+
+// field offsets worth overwriting, the lengths, indices and addresses
+const static int FIELDS[] = {
+    packet::header::type::offset,
+    packet::map::size::offset,
+    packet::map::address::offset,
+    packet::laser::index::offset,
+    packet::text::str_length::offset,
+};
+
+/*!
+ * xorshift32; rand() is not the same everywhere, this is
+ */
+class xorshift {
+public:
+    xorshift(uint32_t seed) : m_x(seed ? seed : 1) {}
+
+    uint32_t next() {
+        m_x ^= m_x << 13;
+        m_x ^= m_x >> 17;
+        m_x ^= m_x << 5;
+        return m_x;
+    }
+
+    size_t below(size_t n) {
+        return n ? next() % n : 0;
+    }
+
+private:
+    uint32_t m_x;
+};
+
+/*!
+ * Finds the start of a random message
+ * @return its offset, or the input's length if there is none
+ */
+static size_t randomMessage(const vector<unsigned char>& in, xorshift& rng) {
+    size_t start = rng.below(in.size());
+    for (size_t i = start; i + packet::HEADER_LENGTH <= in.size(); i++) {
+        if (equal(packet::HEADER, packet::HEADER + packet::HEADER_LENGTH, in.begin() + i)) {
+            return i;
+        }
+    }
+    return in.size();
+}
+
+/*!
+ * Applies a handful of random mutations
+ * @param in the input to mutate
+ * @param rng where the mutations come from
+ */
+static void mutate(vector<unsigned char>& in, xorshift& rng) {
+    int count = 1 + rng.below(8);
+    for (int m = 0; m < count && !in.empty(); m++) {
+        size_t pos = rng.below(in.size());
+        size_t len = 1 + rng.below(min(in.size() - pos, static_cast<size_t>(64)));
+
+        switch (rng.below(8)) {
+            case 0: // flip bytes
+                for (size_t i = 0; i < len; i++) {
+                    in[pos + i] ^= 1 << rng.below(8);
+                }
+                break;
+            case 1: // insert random bytes
+                for (size_t i = 0; i < len; i++) {
+                    in.insert(in.begin() + pos, static_cast<unsigned char>(rng.next()));
+                }
+                break;
+            case 2: // delete bytes
+                in.erase(in.begin() + pos, in.begin() + pos + len);
+                break;
+            case 3: { // repeat bytes
+                vector<unsigned char> copy(in.begin() + pos, in.begin() + pos + len);
+                in.insert(in.begin() + rng.below(in.size()), copy.begin(), copy.end());
+                break;
+            }
+            case 4: // drop in a header
+                in.insert(in.begin() + pos, packet::HEADER, packet::HEADER + packet::HEADER_LENGTH);
+                break;
+            case 5: // drop in a footer
+                in.insert(in.begin() + pos, packet::FOOTER, packet::FOOTER + packet::FOOTER_LENGTH);
+                break;
+            case 6: { // overwrite a field of a message
+                size_t msg = randomMessage(in, rng);
+                size_t field = msg + FIELDS[rng.below(sizeof(FIELDS) / sizeof(FIELDS[0]))];
+                uint32_t value = rng.next();
+                switch (rng.below(3)) {
+                    case 0: // near the sizes that matter
+                        value %= 1 << 17;
+                        break;
+                    case 1: // near overflowing when added to
+                        value = 0x7fffffff - value % 16;
+                        break;
+                }
+                for (int i = 0; i < 4 && field + i < in.size(); i++) {
+                    in[field + i] = value >> (8 * i);
+                }
+                break;
+            }
+            case 7: // cut short
+                in.resize(pos);
+                break;
+        }
+    }
+}
+
+/*!
+ * Reads a whole file
+ * @return true if successful
+ */
+static bool readFile(const char *filename, vector<unsigned char>& data) {
+    ifstream file(filename, ios::in | ios::binary);
+    if (!file) {
+        return false;
+    }
+    data.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    return true;
+}
+
+/*!
+ * Runs diffParse, saving the input if it fails
+ * @return true if the parsers agreed
+ */
+static bool check(const vector<unsigned char>& data, uint32_t seed, const string& what, int& failures) {
+    string why;
+    if (diffParse(data.data(), data.size(), seed, why)) {
+        return true;
+    }
+
+    ostringstream name;
+    name << "difftest-failure-" << failures++ << ".bin";
+    cerr << what << ": " << why << endl;
+    cerr << "\tsaved as " << name.str() << endl;
+
+    // in the fuzz target's format, seed first
+    ofstream out(name.str().c_str(), ios::out | ios::binary | ios::trunc);
+    out.write(reinterpret_cast<const char *>(&seed), sizeof(seed));
+    out.write(reinterpret_cast<const char *>(data.data()), data.size());
+    return false;
+}
+
+int main(int argc, char **argv) {
+    int mutations = 100;
+    uint32_t seed = 1;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:s:h?")) != -1) {
+        switch (c) {
+            case 'n':
+                mutations = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                cout << "Usage: difftest [-n mutations] [-s seed] [file ...]" << endl;
+                return -1;
+        }
+    }
+
+    vector<const char *> files(argv + optind, argv + argc);
+    if (files.empty()) {
+        files.assign(DEFAULT_FILES, DEFAULT_FILES + sizeof(DEFAULT_FILES) / sizeof(DEFAULT_FILES[0]));
+    }
+
+    int failures = 0;
+    xorshift rng(seed);
+    for (unsigned int f = 0; f < files.size(); f++) {
+        vector<unsigned char> data;
+        if (!readFile(files[f], data)) {
+            cerr << "Could not open file " << files[f] << endl;
+            return -1;
+        }
+
+        cout << files[f] << endl;
+        for (uint32_t s = 1; s <= SEEDS; s++) {
+            check(data, s, files[f], failures);
+        }
+
+        for (int m = 0; m < mutations; m++) {
+            // mutate a window of the capture, so each run stays quick
+            size_t start = rng.below(data.size());
+            size_t len = min(data.size() - start, static_cast<size_t>(1 + rng.below(1 << 16)));
+            vector<unsigned char> in(data.begin() + start, data.begin() + start + len);
+            mutate(in, rng);
+
+            ostringstream what;
+            what << files[f] << ", mutation " << m;
+            check(in, rng.next(), what.str(), failures);
+        }
+    }
+
+    cout << failures << " failures" << endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * libFuzzer target for the parser, built with make fuzz (needs clang):
+ *
+ *     bin/fuzz_parser -dict=fuzz/parser.dict corpus/ example/
+ *
+ * Each input is run through diffParse, so besides the sanitizers catching
+ * bad reads and writes, any difference between the byte at a time and the
+ * block parser aborts the run. The first four bytes pick the block sizes.
+ */
+
+#include <iostream>
+#include <cstdlib>
+#include <string.h>
+#include "diffcheck.h"
+
+using namespace std;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    uint32_t seed = 0;
+    if (size >= sizeof(seed)) {
+        memcpy(&seed, data, sizeof(seed));
+        data += sizeof(seed);
+        size -= sizeof(seed);
+    }
+
+    string why;
+    if (!diffParse(data, size, seed, why)) {
+        cerr << "Parsers differ, " << why << endl;
+        abort();
+    }
+    return 0;
+}
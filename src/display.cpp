@@ -0,0 +1,106 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "display.h"
+#include "signals.h"
+#include <vector>
+#include <chrono>
+#include <opencv2/highgui/highgui.hpp>
+
+using namespace std;
+using namespace cv;
+
+display::display(int fps) : m_stop(false) {
+    m_interval = max(1000 / (fps > 0 ? fps : 30), 1);
+}
+
+display::~display() {
+    stop();
+}
+
+void display::start() {
+    if (!m_thread.joinable()) {
+        m_stop = false;
+        m_thread = std::thread(&display::run, this);
+    }
+}
+
+void display::stop() {
+    if (m_thread.joinable()) {
+        {
+            lock_guard<mutex> lk(m_lock);
+            m_stop = true;
+        }
+        m_thread.join();
+    }
+}
+
+void display::show(const string& name, const Mat& img, int x, int y) {
+    lock_guard<mutex> lk(m_lock);
+    window& w = m_windows[name];
+    if (!w.created && !w.dirty) {
+        w.x = x;
+        w.y = y;
+    }
+    w.img = img;
+    w.dirty = true;
+}
+
+void display::run() {
+    blockSignals();
+
+    vector<pair<string, window> > changed;
+    bool opened = false;
+
+    for (;;) {
+        changed.clear();
+        {
+            lock_guard<mutex> lk(m_lock);
+            if (m_stop) {
+                break;
+            }
+            for (map<string, window>::iterator it = m_windows.begin(); it != m_windows.end(); ++it) {
+                if (it->second.dirty) {
+                    changed.push_back(*it);
+                    it->second.dirty = false;
+                    it->second.created = true;
+                }
+            }
+        }
+
+        for (unsigned int i = 0; i < changed.size(); i++) {
+            const string& name = changed[i].first;
+            const window& w = changed[i].second;
+            if (!w.created) {
+                namedWindow(name, CV_WINDOW_AUTOSIZE);
+                if (w.x >= 0 && w.y >= 0) {
+                    moveWindow(name, w.x, w.y);
+                }
+            }
+            imshow(name, w.img);
+            opened = true;
+        }
+
+        // handles window events and paces the redraws; without a window
+        // waitKey may return straight away
+        if (opened) {
+            waitKey(m_interval);
+        } else {
+            this_thread::sleep_for(chrono::milliseconds(m_interval));
+        }
+    }
+}
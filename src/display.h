@@ -0,0 +1,97 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DISPLAY_H_
+#define DISPLAY_H_
+
+#include <map>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <opencv2/core/core.hpp>
+
+using std::string;
+using cv::Mat;
+
+/*
+ * Shows images in OpenCV windows from a thread of its own. Parsers hand over
+ * each new image with show and carry on; the display thread redraws every
+ * window that changed at most fps times a second, so images posted in between
+ * are never drawn and never slow the parser down. All highgui calls happen on
+ * the display thread.
+ */
+class display {
+/* public functions */
+public:
+    /*!
+     * Constructs a display; no windows are opened until images are shown
+     * @param fps the most times a second windows are redrawn; 0 or less is
+     * taken as 30
+     */
+    display(int fps = 30);
+
+    /*!
+     * Stops the display thread
+     */
+    virtual ~display();
+
+    /*!
+     * Starts the display thread
+     */
+    void start();
+
+    /*!
+     * Stops the display thread
+     */
+    void stop();
+
+    /*!
+     * Replaces the image in a window, opening it if needed. The image is
+     * not copied, so it must not be modified afterwards.
+     * @param window the window name
+     * @param img the image
+     * @param x where to put the window if it is new, -1 to leave it be
+     * @param y where to put the window if it is new, -1 to leave it be
+     */
+    void show(const string& window, const Mat& img, int x = -1, int y = -1);
+
+/* private functions */
+private:
+    /*!
+     * Display thread: redraws changed windows until stopped
+     */
+    void run();
+
+    display(const display&);
+    display& operator=(const display&);
+
+    struct window {
+        Mat img;
+        bool dirty;     // img has not been drawn yet
+        bool created;
+        int x;
+        int y;
+    };
+
+    std::map<string, window> m_windows;
+    std::mutex m_lock;
+    std::thread m_thread;
+    bool m_stop;
+    int m_interval;     // ms between redraws
+};
+
+#endif /* DISPLAY_H_ */
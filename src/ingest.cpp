@@ -0,0 +1,108 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ingest.h"
+#include <iostream>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+
+using namespace std;
+
+ingest::ingest() {
+}
+
+ingest::~ingest() {
+}
+
+void ingest::add(stream *s) {
+    m_streams.push_back(s);
+}
+
+void ingest::run(volatile sig_atomic_t& done, const sigset_t *sigmask) {
+    vector<struct pollfd> fds;
+    vector<stream *> active;
+
+    while (!done) {
+        fds.clear();
+        active.clear();
+        bool open = false;
+        int64_t wait = -1;
+        for (unsigned int i = 0; i < m_streams.size(); i++) {
+            stream *s = m_streams[i];
+            if (!s->isOpen()) {
+                continue;
+            }
+            open = true;
+
+            if (s->isSerial()) {
+                struct pollfd pfd;
+                pfd.fd = s->fd();
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                fds.push_back(pfd);
+                active.push_back(s);
+            } else {
+                int64_t w = s->wait();
+                if (w >= 0 && (wait < 0 || w < wait)) {
+                    wait = w;
+                }
+            }
+        }
+
+        if (!open) {
+            break;
+        }
+
+        struct timespec timeout;
+        timeout.tv_sec = wait / 1000000000LL;
+        timeout.tv_nsec = wait % 1000000000LL;
+        if (ppoll(fds.data(), fds.size(), wait >= 0 ? &timeout : NULL, sigmask) < 0) {
+            if (errno != EINTR) {
+                cerr << "poll: " << strerror(errno) << endl;
+                break;
+            }
+            continue;
+        }
+
+        for (unsigned int i = 0; i < fds.size() && !done; i++) {
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                service(active[i]);
+            }
+        }
+
+        for (unsigned int i = 0; i < m_streams.size() && !done; i++) {
+            stream *s = m_streams[i];
+            if (s->isOpen() && !s->isSerial() && s->wait() == 0) {
+                service(s);
+            }
+        }
+    }
+}
+
+void ingest::service(stream *s) {
+    ssize_t len = s->pump();
+    if (len == 0) {
+        if (s->isSerial()) {
+            cerr << "Serial port " << s->path() << " hung up" << endl;
+        }
+        s->close();
+    } else if (len < 0 && errno != EAGAIN && errno != EINTR) {
+        cerr << "Could not read " << s->path() << ": " << strerror(errno) << endl;
+        s->close();
+    }
+}
@@ -0,0 +1,71 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INGEST_H_
+#define INGEST_H_
+
+#include <vector>
+#include <signal.h>
+#include "stream.h"
+
+using std::vector;
+
+/*
+ * Event loop reading any number of streams from one thread. The loop sleeps
+ * in ppoll() until a serial port has data or a dump file's next message is
+ * due, so idle serial ports and paced replays cost nothing.
+ */
+class ingest {
+/* public functions */
+public:
+    /*!
+     * Constructs an empty event loop
+     */
+    ingest();
+
+    /*!
+     * Destructs the event loop; streams are not owned and are left open
+     */
+    virtual ~ingest();
+
+    /*!
+     * Adds an open stream to the loop
+     * @param s the stream to read from
+     */
+    void add(stream *s);
+
+    /*!
+     * Reads from the streams until all of them are closed or done is set
+     * @param done set asynchronously (e.g. from a signal handler) to stop
+     * @param sigmask signal mask while waiting, see ppoll; block the
+     * signals that set done before calling and unblock them here, or they
+     * may arrive just before the wait and not end it
+     */
+    void run(volatile sig_atomic_t& done, const sigset_t *sigmask = NULL);
+
+/* private functions */
+private:
+    /*!
+     * Pumps a stream, closing it at the end of its input or on errors
+     * @param s the stream
+     */
+    void service(stream *s);
+
+    vector<stream *> m_streams;
+};
+
+#endif /* INGEST_H_ */
@@ -18,12 +18,13 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <cstdlib>
 #include <unistd.h>
-#include <termios.h>
 #include <signal.h>
-#include <fcntl.h>
-#include <string.h>
 #include "parser.h"
+#include "stream.h"
+#include "ingest.h"
+#include "display.h"
 
 using namespace std;
 
@@ -34,19 +35,27 @@ struct args_t {
     bool text;          // true if -t is present
     bool map;           // true if -m is present
     bool odom;          // true if -o is present
-    char *filename;     // path to dump file (-f)
-    char *serialport;   // path to serial port (-p)
+    bool unknown;       // true if -u is present
+    vector<char *> filenames;   // paths to dump files (-f)
+    vector<char *> serialports; // paths to serial ports (-p)
     char *gifname;      // path to save gif (-g)
     char *lasergifname; // path to save laser gif (-a)
+    char *logdir;       // directory for per-stream logs (-d)
+    char *pubname;      // name to publish decoded data under (-s)
+    char *capturename;  // path prefix to record raw input to (-r)
+    unsigned long rotatesize;   // MB per capture file (-R)
+    unsigned long maxframes;    // gif frames kept (-M)
+    double maxage;      // seconds of gif frames kept (-A)
+    int fps;            // gui refresh rate (-F)
+    double speed;       // dump file replay speed (-x)
+    char *mapname;      // path to save map snapshots (-e)
 } args;
 
-static const char *optstring = "cvltmof:p:g:a:h?";
+static const char *optstring = "cvltmouf:p:g:a:d:s:r:R:M:A:F:x:e:h?";
 
-static const char *activation_cmd = "SetStreamFormat packet\r\n";
-    
-parser p("XV-11 Parser", false); 
-
-bool done = false;
+volatile sig_atomic_t done = 0;
+volatile sig_atomic_t snapshot = 0;
+volatile sig_atomic_t wake = 0;     // stops the ingest loop for either
 
 void displayUsage() {
     cout << "XV-11 Parser v0.1" << endl;
@@ -54,8 +63,9 @@ void displayUsage() {
     cout << "Released under the GPLv3" << endl;
     cout << endl;
     cout << "Usage:" << endl;
-    cout << "\tparser [-cvltm] -f dumpfile [-g gifname] [-a lasergifname]" << endl;
-    cout << "\tparser [-cvltm] -p serialport [-g gifname] [-a lasergifname]" << endl;
+    cout << "\tparser [-cvltmou] -f dumpfile [-g gifname] [-a lasergifname]" << endl;
+    cout << "\tparser [-cvltmou] -p serialport [-g gifname] [-a lasergifname]" << endl;
+    cout << "\tparser [-cvltmou] [-d logdir] -p serialport -p serialport -f dumpfile ..." << endl;
     cout << endl;
     cout << "Options:" << endl;
     cout << "\t-c\t\tCLI Mode; all output printed to stdout" << endl;
@@ -64,16 +74,69 @@ void displayUsage() {
     cout << "\t-t\t\tText messages printed to stdout" << endl;
     cout << "\t-m\t\tMap messages printed to stdout" << endl;
     cout << "\t-o\t\tOdometry messages printed to stdout" << endl;
-    cout << "\t-f\t\tPath to serial dump file" << endl;
-    cout << "\t-p\t\tSerial device name" << endl;
+    cout << "\t-u\t\tUnknown messages printed to stdout, summarized on exit" << endl;
+    cout << "\t-f\t\tPath to serial dump file, may be repeated" << endl;
+    cout << "\t-p\t\tSerial device name, may be repeated" << endl;
     cout << "\t-g\t\tPath to save gif to" << endl;
     cout << "\t-a\t\tPath to save laser gif to" << endl;
+    cout << "\t-d\t\tDirectory to log each input's messages to instead of stdout" << endl;
+    cout << "\t-s\t\tPublish decoded data to shared memory /name and socket /tmp/name.sock" << endl;
+    cout << "\t-r\t\tRecord raw input to capture files starting with this path" << endl;
+    cout << "\t-R\t\tStart a new capture file every this many MB" << endl;
+    cout << "\t-M\t\tKeep only the latest this many frames of each gif" << endl;
+    cout << "\t-A\t\tKeep only the latest this many seconds of each gif" << endl;
+    cout << "\t-F\t\tMost times a second the gui is redrawn, more than 0 (default 30)" << endl;
+    cout << "\t-x\t\tReplay dump files at this multiple of the recorded speed;" << endl;
+    cout << "\t\t\t0 (default) replays as fast as possible" << endl;
+    cout << "\t-e\t\tPath to save the map to as .png or .pgm, on exit and on SIGUSR1" << endl;
     cout << "\t-h\t\tDisplay usage" << endl;
     cout << endl;
+    cout << "With several inputs, output file names get the input's name inserted" << endl;
+    cout << "before the extension, e.g. -g map.gif writes map-ttyUSB0.gif" << endl;
+    cout << endl;
 }
 
 void term(int signum) {
-    done = true;
+    done = 1;
+    wake = 1;
+}
+
+void requestSnapshot(int signum) {
+    snapshot = 1;
+    wake = 1;
+}
+
+/*!
+ * Names an output file of one stream
+ * @param filename the name given on the command line
+ * @param s the stream
+ * @param multiple true if there is more than one stream
+ * @return filename, with the stream's name inserted if multiple is set
+ */
+string outputName(const char *filename, const stream& s, bool multiple) {
+    string out(filename);
+    if (multiple) {
+        size_t dot = out.find_last_of('.');
+        size_t slash = out.find_last_of('/');
+        if (dot == string::npos || (slash != string::npos && dot < slash)) {
+            dot = out.size();
+        }
+        out.insert(dot, "-" + s.name());
+    }
+    return out;
+}
+
+/*!
+ * Writes the current map of every stream
+ * @param streams the streams
+ * @param multiple true if there is more than one stream
+ */
+void writeSnapshots(const vector<stream *>& streams, bool multiple) {
+    for (unsigned int i = 0; i < streams.size(); i++) {
+        string mapname = outputName(args.mapname, *streams[i], multiple);
+        cout << "Writing map to " << mapname << endl;
+        streams[i]->getParser().getMap().write(mapname.c_str());
+    }
 }
 
 int main (int argc, char** argv) {
@@ -82,13 +145,21 @@ int main (int argc, char** argv) {
     args.text = false;
     args.map = false;
     args.odom = false;
+    args.unknown = false;
     args.verbose = false;
-    args.filename = NULL;
-    args.serialport = NULL;
     args.lasergifname = NULL;
     args.gifname = NULL;
+    args.logdir = NULL;
+    args.pubname = NULL;
+    args.capturename = NULL;
+    args.rotatesize = 0;
+    args.maxframes = 0;
+    args.maxage = 0;
+    args.fps = 30;
+    args.speed = 0;
+    args.mapname = NULL;
 
-    char c;
+    int c;
 
     // process arguments
     while ((c = getopt(argc, argv, optstring)) != -1) {
@@ -111,11 +182,14 @@ int main (int argc, char** argv) {
             case 'm':
                 args.map = true;
                 break;
+            case 'u':
+                args.unknown = true;
+                break;
             case 'f':
-                args.filename = optarg;
+                args.filenames.push_back(optarg);
                 break;
             case 'p':
-                args.serialport = optarg;
+                args.serialports.push_back(optarg);
                 break;
             case 'g':
                 args.gifname = optarg;
@@ -123,6 +197,37 @@ int main (int argc, char** argv) {
             case 'a':
                 args.lasergifname = optarg;
                 break;
+            case 'd':
+                args.logdir = optarg;
+                break;
+            case 's':
+                args.pubname = optarg;
+                break;
+            case 'r':
+                args.capturename = optarg;
+                break;
+            case 'R':
+                args.rotatesize = strtoul(optarg, NULL, 10);
+                break;
+            case 'M':
+                args.maxframes = strtoul(optarg, NULL, 10);
+                break;
+            case 'A':
+                args.maxage = strtod(optarg, NULL);
+                break;
+            case 'F':
+                args.fps = atoi(optarg);
+                if (args.fps <= 0) {
+                    cerr << "-F must be more than 0" << endl;
+                    return -1;
+                }
+                break;
+            case 'x':
+                args.speed = strtod(optarg, NULL);
+                break;
+            case 'e':
+                args.mapname = optarg;
+                break;
             case 'h':
             case '?':
                 displayUsage();
@@ -131,25 +236,18 @@ int main (int argc, char** argv) {
         }
     }
 
-    if (args.filename && args.serialport) {
-        cerr << "You can supply a path to a serial dump file OR a path to a serial port, not both" << endl;
-        return -1;
-    }
-
-    if (!args.filename && !args.serialport) {
+    if (args.filenames.empty() && args.serialports.empty()) {
         displayUsage();
         return -1;
     }
 
-    p.setGui(!args.cli);
-
     int verbosity = 0;
     verbosity |= (args.verbose ? parser::VERB_DEBUG : 0)
         | (args.laser ? parser::VERB_LASER : 0)
         | (args.text ? parser::VERB_TEXT : 0)
         | (args.map ? parser::VERB_MAP : 0)
-        | (args.odom ? parser::VERB_ODOM : 0);
-    p.setVerbosity(verbosity);
+        | (args.odom ? parser::VERB_ODOM : 0)
+        | (args.unknown ? parser::VERB_UNKNOWN : 0);
 
     if (args.cli) {
         cout << "Running in command line mode" << endl;
@@ -159,83 +257,158 @@ int main (int argc, char** argv) {
 
     // override sigint (ctrl-c)
     signal(SIGINT, term);
+    signal(SIGUSR1, requestSnapshot);
+
+    // the signals are only let through while waiting in ppoll or
+    // sigsuspend, so they cannot slip in between checking the flags and
+    // going to sleep
+    sigset_t sigs, unblocked;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &sigs, &unblocked);
+
+    display gui(args.fps);
+    if (!args.cli) {
+        gui.start();
+    }
 
-    if (args.serialport) {
-        struct termios tty_opt;
-        int tty_fd;
+    vector<stream *> streams;
+    for (unsigned int i = 0; i < args.serialports.size(); i++) {
+        streams.push_back(new stream(args.serialports[i], true));
+    }
+    for (unsigned int i = 0; i < args.filenames.size(); i++) {
+        streams.push_back(new stream(args.filenames[i], false));
+    }
+    bool multiple = streams.size() > 1;
 
+    if (!args.serialports.empty()) {
         cerr << "Serial ports not yet supported, use at your own risk" << endl;
+    }
 
-        cout << "Opening serial port " << args.serialport << endl;
-        tty_fd = open(args.serialport, O_RDWR | O_NONBLOCK);
-        if (tty_fd < 0) {
-            cerr << "Could not open port " << args.serialport << endl;
-            return -1;
+    ingest loop;
+    bool ok = true;
+    for (unsigned int i = 0; i < streams.size() && ok; i++) {
+        stream *s = streams[i];
+        parser& p = s->getParser();
+        p.setGui(args.cli ? NULL : &gui);
+        p.setVerbosity(verbosity);
+        p.setRetention(args.maxframes, args.maxage);
+        p.keepFrames(args.gifname != NULL, args.lasergifname != NULL);
+        s->setSpeed(args.speed);
+
+        if (args.logdir) {
+            string logname = string(args.logdir) + "/" + s->name() + ".log";
+            if (!s->openLog(logname)) {
+                cerr << "Could not open log " << logname << endl;
+                ok = false;
+                break;
+            }
         }
 
-        memset(&tty_opt, 0, sizeof(tty_opt));
-        
-        tty_opt.c_cflag = CS8 | CLOCAL | CREAD; // 8N1
-        tty_opt.c_iflag = 0;
-        tty_opt.c_oflag = 0;
-        tty_opt.c_lflag = 0; // noncanonical mode
-        tty_opt.c_cc[VMIN] = 1; // one char is enough
-        tty_opt.c_cc[VTIME] = 0; // no timer
+        if (args.pubname) {
+            string pubname = outputName(args.pubname, *s, multiple);
+            cout << "Publishing to /" << pubname << endl;
+            if (!s->publish(pubname)) {
+                ok = false;
+                break;
+            }
+        }
 
-        cfsetospeed(&tty_opt, B115200); // 115200 baud
-        cfsetispeed(&tty_opt, B115200); // 115200 baud
+        if (args.capturename) {
+            string capturename = outputName(args.capturename, *s, multiple);
+            cout << "Recording to " << capturename << ".NNNN" << endl;
+            if (!s->record(capturename, args.rotatesize << 20)) {
+                ok = false;
+                break;
+            }
+        }
 
-        tcsetattr(tty_fd, TCSANOW, &tty_opt);
+        if (s->isSerial()) {
+            cout << "Opening serial port " << s->path() << endl;
+        } else {
+            cout << "Opening input file " << s->path() << endl;
+        }
+        if (!s->open()) {
+            cerr << "Could not open " << (s->isSerial() ? "port " : "file ") << s->path() << endl;
+            ok = false;
+            break;
+        }
+        loop.add(s);
+    }
 
-        if (write(tty_fd, activation_cmd, strlen(activation_cmd))) {
-            while (!done) {
-                unsigned char c;
-                if (read(tty_fd, &c, 1) > 0) {
-                    p.update(c);
-                }      
+    if (ok) {
+        cout << "Parsing..." << endl;
+        for (;;) {
+            wake = 0;
+            loop.run(wake, &unblocked);
+            if (snapshot) {
+                snapshot = 0;
+                if (args.mapname) {
+                    writeSnapshots(streams, multiple);
+                }
+            }
+            // otherwise every stream has ended
+            if (done || !wake) {
+                break;
             }
-            close(tty_fd);
-        } else {
-            cerr << "Couldn't write activation command" << endl;
-            return -1;
         }
 
-    } else if (args.filename) {
-        cout << "Opening input file " << args.filename << endl;
-        ifstream file(args.filename, ios::in | ios::binary | ios::ate);
-        if (file.is_open()) {
-            cout << "Parsing file..." << endl;
-            ifstream::pos_type size = file.tellg();
-            file.seekg(0, ios::beg);
-
-            // simulating serial input here
-            cout << "Iterating through chars" << endl;
-            for (int index = 0; index < size && !done; index++) {
-                char c;
-                file.read(&c, 1); // c now has new char
-                p.update(c);
+        if (args.serialports.empty() && !args.cli) {
+            cout << "Ctrl-C to exit" << endl;
+
+            while (!done) {
+                sigsuspend(&unblocked);
+                if (snapshot) {
+                    snapshot = 0;
+                    if (args.mapname) {
+                        writeSnapshots(streams, multiple);
+                    }
+                }
             }
-            file.close();
+        }
+
+        if (args.mapname) {
+            writeSnapshots(streams, multiple);
+        }
+
+        for (unsigned int i = 0; i < streams.size(); i++) {
+            stream *s = streams[i];
 
-            if (!args.cli) {
-                cout << "Ctrl-C to exit" << endl;
-                while (!done) {
-                    usleep(1000);
+            if (args.verbose) {
+                parser::memory_usage usage = s->getParser().memoryUsage();
+                cout << s->path() << ": " << usage.map_frames << " map frames, "
+                    << usage.laser_frames << " laser frames, ~" << (usage.image_bytes >> 10)
+                    << " KB of images, " << usage.map_cache << " bytes of map tiles, "
+                    << usage.resyncs << " messages dropped" << endl;
+                if (args.capturename) {
+                    cout << s->path() << ": ~" << (usage.capture_bytes >> 10) << " KB of capture buffers, "
+                        << usage.capture_dropped << " bytes not recorded" << endl;
                 }
             }
-        } else {
-            cerr << "Could not open file " << args.filename << endl;
-            return -1;
+
+            if (args.unknown) {
+                cout << "Unknown message types in " << s->path() << ":" << endl;
+                s->getParser().writeUnknown(cout);
+            }
+
+            if (args.gifname) {
+                string gifname = outputName(args.gifname, *s, multiple);
+                cout << "Writing map gif to " << gifname << endl;
+                s->getParser().writeMap(gifname.c_str());
+            }
+
+            if (args.lasergifname) {
+                string gifname = outputName(args.lasergifname, *s, multiple);
+                cout << "Writing laser gif to " << gifname << endl;
+                s->getParser().writeAnim(gifname.c_str());
+            }
         }
     }
 
-    if (args.gifname) {
-        cout << "Writing map gif to " << args.gifname << endl;
-        p.writeMap(args.gifname);
+    for (unsigned int i = 0; i < streams.size(); i++) {
+        delete streams[i];
     }
 
-    if (args.lasergifname) {
-        cout << "Writing laser gif to " << args.lasergifname << endl;
-        p.writeAnim(args.lasergifname);
-    }
+    return ok ? 0 : -1;
 }
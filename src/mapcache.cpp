@@ -0,0 +1,218 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mapcache.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+using namespace std;
+
+const static int RUN_MAX = 256;
+
+/*!
+ * Appends a PNG chunk
+ * @param out the PNG so far
+ * @param type the chunk type
+ * @param data the chunk's contents
+ * @param len length of data
+ */
+static void pngChunk(string& out, const char *type, const unsigned char *data, size_t len) {
+    unsigned char be[4] = {
+        static_cast<unsigned char>(len >> 24), static_cast<unsigned char>(len >> 16),
+        static_cast<unsigned char>(len >> 8), static_cast<unsigned char>(len),
+    };
+    out.append(reinterpret_cast<char *>(be), 4);
+
+    size_t start = out.size();
+    out.append(type, 4);
+    out.append(reinterpret_cast<const char *>(data), len);
+
+    uLong crc = crc32(0, reinterpret_cast<const Bytef *>(out.data() + start), len + 4);
+    be[0] = crc >> 24;
+    be[1] = crc >> 16;
+    be[2] = crc >> 8;
+    be[3] = crc;
+    out.append(reinterpret_cast<char *>(be), 4);
+}
+
+mapcache::mapcache() : m_version(0) {
+    unsigned char black[TILE * TILE];
+    memset(black, 0, sizeof(black));
+    for (int i = 0; i < TILES_X * TILES_Y; i++) {
+        encode(i, black);
+    }
+}
+
+void mapcache::update(size_t address, const unsigned char *data, size_t len) {
+    if (address >= WIDTH * HEIGHT) {
+        return;
+    }
+    len = min(len, static_cast<size_t>(WIDTH * HEIGHT) - address);
+    if (len == 0) {
+        return;
+    }
+
+    size_t end = address + len;
+    int first_row = address / WIDTH;
+    int last_row = (end - 1) / WIDTH;
+    unsigned char pixels[TILE * TILE];
+
+    for (int ty = first_row / TILE; ty <= last_row / TILE; ty++) {
+        for (int tx = 0; tx < TILES_X; tx++) {
+            int tile = ty * TILES_X + tx;
+            bool touched = false;
+
+            for (int y = 0; y < TILE; y++) {
+                size_t row = static_cast<size_t>(ty * TILE + y) * WIDTH + tx * TILE;
+                size_t from = max(row, address);
+                size_t to = min(row + TILE, end);
+                if (from >= to) {
+                    continue;
+                }
+                if (!touched) {
+                    decode(tile, pixels);
+                    touched = true;
+                }
+                memcpy(pixels + y * TILE + (from - row), data + (from - address), to - from);
+            }
+
+            if (touched) {
+                encode(tile, pixels);
+            }
+        }
+    }
+    m_version++;
+}
+
+void mapcache::snapshot(unsigned char *img) const {
+    unsigned char pixels[TILE * TILE];
+    for (int ty = 0; ty < TILES_Y; ty++) {
+        for (int tx = 0; tx < TILES_X; tx++) {
+            decode(ty * TILES_X + tx, pixels);
+            for (int y = 0; y < TILE; y++) {
+                memcpy(img + (ty * TILE + y) * WIDTH + tx * TILE, pixels + y * TILE, TILE);
+            }
+        }
+    }
+}
+
+size_t mapcache::size() const {
+    size_t bytes = 0;
+    for (int i = 0; i < TILES_X * TILES_Y; i++) {
+        bytes += m_tiles[i].capacity();
+    }
+    return bytes;
+}
+
+unsigned long mapcache::version() const {
+    return m_version;
+}
+
+bool mapcache::writePGM(const char *filename) const {
+    vector<unsigned char> img(WIDTH * HEIGHT);
+    snapshot(img.data());
+
+    ofstream file(filename, ios::out | ios::binary | ios::trunc);
+    file << "P5\n" << WIDTH << " " << HEIGHT << "\n255\n";
+    file.write(reinterpret_cast<char *>(img.data()), img.size());
+    if (!file) {
+        cerr << "Could not write " << filename << endl;
+        return false;
+    }
+    return true;
+}
+
+bool mapcache::writePNG(const char *filename) const {
+    vector<unsigned char> img(WIDTH * HEIGHT);
+    snapshot(img.data());
+
+    // every row starts with its filter type, 0 for none
+    vector<unsigned char> raw((WIDTH + 1) * HEIGHT);
+    for (int y = 0; y < HEIGHT; y++) {
+        raw[y * (WIDTH + 1)] = 0;
+        memcpy(&raw[y * (WIDTH + 1) + 1], &img[y * WIDTH], WIDTH);
+    }
+
+    uLongf zlen = compressBound(raw.size());
+    vector<unsigned char> zdata(zlen);
+    if (compress(zdata.data(), &zlen, raw.data(), raw.size()) != Z_OK) {
+        cerr << "Could not compress " << filename << endl;
+        return false;
+    }
+
+    // 8 bit greyscale, deflate, no interlacing
+    const unsigned char ihdr[13] = {
+        0, 0, WIDTH >> 8, WIDTH & 0xff,
+        0, 0, HEIGHT >> 8, HEIGHT & 0xff,
+        8, 0, 0, 0, 0,
+    };
+    string out("\x89PNG\r\n\x1a\n", 8);
+    pngChunk(out, "IHDR", ihdr, sizeof(ihdr));
+    pngChunk(out, "IDAT", zdata.data(), zlen);
+    pngChunk(out, "IEND", NULL, 0);
+
+    ofstream file(filename, ios::out | ios::binary | ios::trunc);
+    file.write(out.data(), out.size());
+    if (!file) {
+        cerr << "Could not write " << filename << endl;
+        return false;
+    }
+    return true;
+}
+
+bool mapcache::write(const char *filename) const {
+    size_t len = strlen(filename);
+    if (len >= 4 && strcasecmp(filename + len - 4, ".png") == 0) {
+        return writePNG(filename);
+    }
+    return writePGM(filename);
+}
+
+void mapcache::decode(int tile, unsigned char *pixels) const {
+    const vector<unsigned char>& runs = m_tiles[tile];
+    for (size_t i = 0; i + 1 < runs.size(); i += 2) {
+        int len = runs[i] + 1;
+        memset(pixels, runs[i + 1], len);
+        pixels += len;
+    }
+}
+
+void mapcache::encode(int tile, const unsigned char *pixels) {
+    vector<unsigned char>& runs = m_tiles[tile];
+    runs.clear();
+
+    const unsigned char *end = pixels + TILE * TILE;
+    while (pixels < end) {
+        unsigned char value = *pixels;
+        const unsigned char *run = pixels + 1;
+        while (run < end && *run == value && run - pixels < RUN_MAX) {
+            run++;
+        }
+        runs.push_back(static_cast<unsigned char>(run - pixels - 1));
+        runs.push_back(value);
+        pixels = run;
+    }
+    // a tile that was once noisy would otherwise keep its worst case forever
+    if (runs.capacity() > 2 * runs.size()) {
+        vector<unsigned char>(runs).swap(runs);
+    }
+}
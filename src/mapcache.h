@@ -0,0 +1,118 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAPCACHE_H_
+#define MAPCACHE_H_
+
+#include <vector>
+#include <inttypes.h>
+#include <stddef.h>
+
+using std::vector;
+
+/*
+ * The robot's 256x256 map, kept as 32x32 tiles that are each run-length
+ * encoded. The map is mostly one shade, so a tile is usually a handful of
+ * runs; only the tiles a map message touches are re-encoded.
+ *
+ * Snapshots are written straight from the tiles as PGM or PNG, without going
+ * through ImageMagick, so fetching the current map stays cheap.
+ */
+class mapcache {
+/* public functions */
+public:
+    enum {
+        WIDTH   = 256,
+        HEIGHT  = 256,
+        TILE    = 32,
+        TILES_X = WIDTH / TILE,
+        TILES_Y = HEIGHT / TILE,
+    };
+
+    /*!
+     * Constructs an all black map
+     */
+    mapcache();
+
+    /*!
+     * Overwrites part of the map, as a map message does
+     * @param address offset of the first pixel, row by row
+     * @param data the new pixels
+     * @param len number of pixels; anything past the end of the map is
+     * ignored
+     */
+    void update(size_t address, const unsigned char *data, size_t len);
+
+    /*!
+     * Decodes the whole map
+     * @param img filled with WIDTH * HEIGHT pixels, row by row
+     */
+    void snapshot(unsigned char *img) const;
+
+    /*!
+     * @return bytes held by the encoded tiles
+     */
+    size_t size() const;
+
+    /*!
+     * @return number of updates so far, to tell if the map has changed
+     */
+    unsigned long version() const;
+
+    /*!
+     * Writes the map as a binary PGM
+     * @param filename the file to be written
+     * @return true if successful
+     */
+    bool writePGM(const char *filename) const;
+
+    /*!
+     * Writes the map as a greyscale PNG
+     * @param filename the file to be written
+     * @return true if successful
+     */
+    bool writePNG(const char *filename) const;
+
+    /*!
+     * Writes the map as a PNG if filename ends in .png, as a PGM otherwise
+     * @param filename the file to be written
+     * @return true if successful
+     */
+    bool write(const char *filename) const;
+
+/* private functions */
+private:
+    /*!
+     * Decodes a tile
+     * @param tile the tile's index
+     * @param pixels filled with TILE * TILE pixels, row by row
+     */
+    void decode(int tile, unsigned char *pixels) const;
+
+    /*!
+     * Encodes a tile, replacing what was there
+     * @param tile the tile's index
+     * @param pixels TILE * TILE pixels, row by row
+     */
+    void encode(int tile, const unsigned char *pixels);
+
+    // (run length - 1, value) pairs
+    vector<unsigned char> m_tiles[TILES_X * TILES_Y];
+    unsigned long m_version;
+};
+
+#endif /* MAPCACHE_H_ */
@@ -0,0 +1,212 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PACKET_H_
+#define PACKET_H_
+
+#include <cstddef>
+#include <inttypes.h>
+
+/*
+ * Layouts of the messages sent after SetStreamFormat packet. Every message is
+ *
+ *     HEADER (4) | type (2) | sequence (2) | timestamp (4) | payload | FOOTER (4)
+ *
+ * and each known message type gets a struct below naming its type id, its
+ * payload fields, the shortest message it can be decoded from and how long a
+ * given message must be (known once the first length_at bytes are in). The
+ * parser builds its dispatch table from these, so adding a newly discovered
+ * type is a matter of describing it here and registering a handler for it.
+ */
+namespace packet {
+
+enum {
+    HEADER_LENGTH   = 4,
+    FOOTER_LENGTH   = 4,
+    MAX_TYPES       = 256,  // size of the dispatch table
+};
+
+const unsigned char HEADER[HEADER_LENGTH] = { 0x01, 0x02, 0x03, 0x04 };
+const unsigned char FOOTER[FOOTER_LENGTH] = { 0x40, 0x30, 0x20, 0x10 };
+
+/*!
+ * A little-endian field of type T at a fixed offset in a message
+ */
+template <int OFFSET, typename T>
+struct field {
+    static_assert(sizeof(T) <= 4, "fields are at most 32 bits wide");
+
+    typedef T type;
+
+    enum {
+        offset  = OFFSET,
+        end     = OFFSET + sizeof(T),
+    };
+
+    /*!
+     * Decodes the field, LSB first.
+     * @param msg the start of the message
+     * @return the decoded value
+     */
+    static T get(const unsigned char *msg) {
+        uint32_t tmp = 0;
+        for (unsigned int i = 0; i < sizeof(T); i++) {
+            tmp |= static_cast<uint32_t>(msg[OFFSET + i]) << (8 * i);
+        }
+        return static_cast<T>(tmp);
+    }
+};
+
+/*!
+ * COUNT little-endian values of type T, the first at OFFSET and each
+ * following one STRIDE bytes further
+ */
+template <int OFFSET, int STRIDE, int COUNT, typename T>
+struct array {
+    enum {
+        offset  = OFFSET,
+        stride  = STRIDE,
+        count   = COUNT,
+        end     = OFFSET + STRIDE * (COUNT - 1) + sizeof(T),
+    };
+
+    /*!
+     * Decodes element i of the array
+     * @param msg the start of the message
+     * @param i the index of the element
+     * @return the decoded value
+     */
+    static T get(const unsigned char *msg, int i) {
+        return field<0, T>::get(msg + OFFSET + STRIDE * i);
+    }
+};
+
+/*!
+ * Fields common to every message
+ */
+struct header {
+    typedef field<0x04, int16_t>    type;
+    typedef field<0x06, uint16_t>   sequence;   // increments by one per message
+    typedef field<0x08, uint32_t>   timestamp;      // appears to count microseconds
+
+    enum {
+        length          = 0x0c,
+        ticks_per_sec   = 1000000,
+    };
+};
+
+/*!
+ * Every message must at least hold a header and a footer
+ */
+enum { MIN_LENGTH = header::length + FOOTER_LENGTH };
+
+/*!
+ * 0x01: wheel odometry
+ */
+struct odom {
+    enum { id = 0x01 };
+
+    typedef field<0x0c, int32_t>    left_count;     // maybe encoder counts?
+    typedef field<0x10, int32_t>    right_count;    // maybe encoder counts?
+    typedef field<0x14, int16_t>    left_speed;     // maybe encoder count rate?
+    typedef field<0x16, int16_t>    right_speed;    // maybe encoder count rate?
+    typedef field<0x18, int32_t>    unknown;        // constant at 32000 no clue what this is
+
+    enum {
+        min_length  = unknown::end + FOOTER_LENGTH,
+        max_length  = min_length,
+        length_at   = header::length,
+    };
+
+    static size_t length(const unsigned char *msg) {
+        return min_length;
+    }
+};
+
+/*!
+ * 0x05: a quarter revolution of the laser, as (x, y) pairs
+ */
+struct laser {
+    enum { id = 0x05 };
+
+    typedef field<0x10, int32_t>            index;  // first angle, in degrees
+    typedef array<0x14, 4, 90, int16_t>     x;
+    typedef array<0x16, 4, 90, int16_t>     y;
+
+    enum {
+        min_length  = y::end + FOOTER_LENGTH,
+        max_length  = min_length,
+        length_at   = header::length,
+    };
+
+    static size_t length(const unsigned char *msg) {
+        return min_length;
+    }
+};
+
+/*!
+ * 0x09: a chunk of the 256x256 map image
+ */
+struct map {
+    enum { id = 0x09 };
+
+    typedef field<0x0c, int32_t>    size;
+    typedef field<0x10, int32_t>    address;
+
+    enum {
+        data        = 0x18,
+        padding     = 8,    // bytes after the data that size does not count
+        min_length  = data + FOOTER_LENGTH,
+        max_length  = data + 256 * 256 + padding + FOOTER_LENGTH,
+        length_at   = size::end,
+    };
+
+    static size_t length(const unsigned char *msg) {
+        int32_t len = size::get(msg);
+        return len < 0 ? 0 : data + static_cast<size_t>(len) + padding + FOOTER_LENGTH;
+    }
+};
+
+/*!
+ * 0x11: text output of the robot's command line
+ */
+struct text {
+    enum { id = 0x11 };
+
+    typedef field<0x0c, int32_t>    str_length;
+
+    enum {
+        data        = 0x10,
+        min_length  = data + FOOTER_LENGTH,
+        max_length  = map::max_length,  // nothing better known
+        length_at   = str_length::end,
+    };
+
+    static size_t length(const unsigned char *msg) {
+        int32_t len = str_length::get(msg);
+        return len < 0 ? 0 : data + static_cast<size_t>(len) + FOOTER_LENGTH;
+    }
+};
+
+/*!
+ * No known message is longer, so a message that is can be dropped
+ */
+enum { MAX_LENGTH = map::max_length };
+
+} /* namespace packet */
+
+#endif /* PACKET_H_ */
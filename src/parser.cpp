@@ -21,55 +21,291 @@
 #include <inttypes.h>
 #include <Magick++.h>
 #include <opencv2/core/core.hpp>
-#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
 #include <cmath>
+#include <iomanip>
+#include <algorithm>
 
 using namespace std;
 using namespace Magick;
 using namespace cv;
 
-const static unsigned char HEADER[] = { 0x01, 0x02, 0x03, 0x04 };
-const static unsigned char FOOTER[] = { 0x40, 0x30, 0x20, 0x10 };
+using packet::HEADER;
+using packet::FOOTER;
 
-parser::parser(const char *name, bool gui, int delayTime) : m_name(name) {
-    m_gui_running = gui;
-    m_delay_time = delayTime;
+// bytes of an unknown message kept for writeUnknown
+const static size_t UNKNOWN_SAMPLE_LENGTH = 256;
+
+// distinct unknown types recorded; garbage that happens to be framed like a
+// message would otherwise grow m_unknown without bound
+const static size_t MAX_UNKNOWN = 64;
+
+// ImageMagick keeps four 16 bit channels per pixel
+const static size_t IMAGE_BYTES_PER_PIXEL = 8;
+
+parser::parser(const char *name, display *gui) : m_name(name), m_laser_name(m_name + " Laser") {
+    m_gui = NULL;
     m_verbose = 0;
-    if (m_gui_running) {
-        namedWindow(name, CV_WINDOW_AUTOSIZE);
-        namedWindow("Laser", CV_WINDOW_AUTOSIZE);
-        Mat img = Mat::zeros(512, 512, CV_8UC1);
-        imshow("Laser", img);
-        moveWindow("Laser", 512, 0);
+    m_out = &cout;
+    m_publisher = NULL;
+    m_recorder = NULL;
+    m_timestamp = 0;
+    m_time = 0;
+    m_max_frames = 0;
+    m_keep_map = true;
+    m_keep_laser = true;
+    m_max_age = 0;
+    m_unknown_overflow = 0;
+
+    for (int i = 0; i < 360; i++) {
+        m_laser[i].valid = false;
+    }
+
+    m_buf.reserve(packet::MAX_LENGTH + 1);
+    m_max_length = packet::HEADER_LENGTH - 1;
+    m_length_at = 0;
+    m_resyncs = 0;
+
+    for (int i = 0; i < packet::MAX_TYPES; i++) {
+        m_handlers[i].method = NULL;
+        m_handlers[i].callback = NULL;
+        m_handlers[i].ctx = NULL;
+        m_handlers[i].min_length = packet::MIN_LENGTH;
+        m_handlers[i].max_length = packet::MAX_LENGTH;
+        m_handlers[i].length_at = 0;
+        m_handlers[i].length = NULL;
     }
+    registerLayout<packet::odom>(&parser::processOdom);
+    registerLayout<packet::laser>(&parser::processLaser);
+    registerLayout<packet::map>(&parser::processMap);
+    registerLayout<packet::text>(&parser::processText);
+
+    setGui(gui);
 }
 
 parser::~parser() {
-    if (m_gui_running) {
-
-    }
 }
 
-void parser::setGui(bool gui) {
-    m_gui_running = gui;
+void parser::setGui(display *gui) {
+    m_gui = gui;
+    if (m_gui) {
+        m_gui->show(m_name, Mat::zeros(256, 256, CV_8UC1), 0, 0);
+        m_gui->show(m_laser_name, Mat::zeros(512, 512, CV_8UC1), 512, 0);
+    }
 }
 
 void parser::setVerbosity(int verbose) {
     m_verbose = verbose;
 }
 
+bool parser::registerHandler(int type, msg_callback callback, void *ctx, size_t minLength) {
+    if (type < 0 || type >= packet::MAX_TYPES) {
+        return false;
+    }
+
+    msg_handler& h = m_handlers[type];
+    h.method = NULL;
+    h.callback = callback;
+    h.ctx = ctx;
+    h.min_length = max(minLength, static_cast<size_t>(packet::MIN_LENGTH));
+    h.max_length = packet::MAX_LENGTH;
+    h.length_at = 0;
+    h.length = NULL;
+    return true;
+}
+
+void parser::writeUnknown(ostream& out) {
+    for (std::map<int, unknown_type>::const_iterator it = m_unknown.begin(); it != m_unknown.end(); ++it) {
+        const unknown_type& u = it->second;
+        out << "type 0x" << hex << it->first << dec << ": " << u.count << " messages, "
+            << u.min_length << "-" << u.max_length << " bytes" << endl;
+
+        for (unsigned int i = 0; i < u.sample.size(); i++) {
+            out << ((i % 16) ? " " : "\t") << hex << setw(2) << setfill('0')
+                << static_cast<int>(u.sample[i]) << dec << setfill(' ');
+            if (i % 16 == 15 || i + 1 == u.sample.size()) {
+                out << endl;
+            }
+        }
+    }
+
+    if (m_unknown_overflow) {
+        out << m_unknown_overflow << " messages of further types" << endl;
+    }
+}
+
+void parser::setRetention(size_t maxFrames, double maxAge) {
+    m_max_frames = maxFrames;
+    m_max_age = static_cast<uint64_t>(maxAge * packet::header::ticks_per_sec);
+    retain(m_images, m_image_times);
+    retain(m_laser_images, m_laser_times);
+}
+
+void parser::keepFrames(bool map, bool laser) {
+    m_keep_map = map;
+    m_keep_laser = laser;
+    if (!m_keep_map) {
+        m_images.clear();
+        m_image_times.clear();
+    }
+    if (!m_keep_laser) {
+        m_laser_images.clear();
+        m_laser_times.clear();
+    }
+}
+
+parser::memory_usage parser::memoryUsage() const {
+    memory_usage usage;
+    usage.buffer = m_buf.capacity();
+    usage.map_frames = m_images.size();
+    usage.laser_frames = m_laser_images.size();
+    usage.image_bytes = 0;
+    if (!m_images.empty()) {
+        usage.image_bytes += m_images.size() * m_images.front().columns()
+            * m_images.front().rows() * IMAGE_BYTES_PER_PIXEL;
+    }
+    if (!m_laser_images.empty()) {
+        usage.image_bytes += m_laser_images.size() * m_laser_images.front().columns()
+            * m_laser_images.front().rows() * IMAGE_BYTES_PER_PIXEL;
+    }
+    usage.map_cache = m_map.size();
+    usage.resyncs = m_resyncs;
+    usage.capture_bytes = m_recorder ? m_recorder->bufferSize() : 0;
+    usage.capture_dropped = m_recorder ? m_recorder->dropped() : 0;
+    return usage;
+}
+
+void parser::retain(deque<Image>& images, deque<uint64_t>& times) {
+    while (!images.empty() && ((m_max_frames && images.size() > m_max_frames)
+                || (m_max_age && m_time - times.front() > m_max_age))) {
+        images.pop_front();
+        times.pop_front();
+    }
+}
+
+void parser::publishStats() {
+    if (m_publisher) {
+        memory_usage usage = memoryUsage();
+        pub_stats stats;
+        stats.buffer_bytes = usage.buffer;
+        stats.image_bytes = usage.image_bytes;
+        stats.map_frames = usage.map_frames;
+        stats.laser_frames = usage.laser_frames;
+        stats.resyncs = usage.resyncs;
+        stats.capture_bytes = usage.capture_bytes;
+        stats.capture_dropped = usage.capture_dropped;
+        stats.map_cache_bytes = usage.map_cache;
+        m_publisher->publishStats(stats);
+    }
+}
+
+void parser::setOutput(ostream& out) {
+    m_out = &out;
+}
+
+void parser::setPublisher(publisher *pub) {
+    m_publisher = pub;
+}
+
+void parser::setRecorder(const recorder *rec) {
+    m_recorder = rec;
+}
+
+/*!
+ * @return true if c could be the last byte of a header or footer
+ */
+static inline bool endsMarker(char c) {
+    return static_cast<unsigned char>(c) == HEADER[packet::HEADER_LENGTH - 1]
+        || static_cast<unsigned char>(c) == FOOTER[packet::FOOTER_LENGTH - 1];
+}
+
+void parser::update(const char *data, size_t len) {
+    // Does what calling update(char) for every byte would, but only bytes
+    // that could complete a header or footer, or that bring the message to
+    // a length that has to be checked, go through it. The rest are skipped
+    // while looking for a header and copied in bulk within a message.
+    const char *end = data + len;
+    while (data < end) {
+        size_t size = m_buf.size();
+
+        if (m_max_length == packet::HEADER_LENGTH - 1 && size <= m_max_length) {
+            // looking for a header: resync would keep only the last three
+            const char *stop = find_if(data, end, endsMarker);
+            if (stop - data >= packet::HEADER_LENGTH - 1) {
+                m_buf.assign(stop - (packet::HEADER_LENGTH - 1), stop);
+            } else if (stop > data) {
+                m_buf.insert(m_buf.end(), data, stop);
+                if (m_buf.size() > packet::HEADER_LENGTH - 1) {
+                    m_buf.erase(m_buf.begin(), m_buf.end() - (packet::HEADER_LENGTH - 1));
+                }
+            }
+            data = stop;
+        } else if (size < m_max_length && (m_length_at == 0 || size + 1 < m_length_at)) {
+            size_t room = m_max_length - size;
+            if (m_length_at) {
+                room = min(room, m_length_at - size - 1);
+            }
+            const char *stop = find_if(data, data + min(room, static_cast<size_t>(end - data)), endsMarker);
+            m_buf.insert(m_buf.end(), data, stop);
+            data = stop;
+        }
+
+        if (data < end) {
+            update(*data++);
+        }
+    }
+}
+
 void parser::update(char c) {
     m_buf.push_back(c); // store the character
 
     if (is_footer(m_buf.size() - 1)) { // if end of message
         processMsg();
         m_buf.clear(); // clear the m_buffer
+        m_max_length = packet::HEADER_LENGTH - 1; // wait for the next header
+        m_length_at = 0;
     } else if (is_header(m_buf.size() - 1)) { // if end of header
         m_buf.clear();
         for (int i = 0; i < 4; i++) {
             m_buf.push_back(HEADER[i]);
         }
-    } 
+        m_max_length = packet::MAX_LENGTH;
+        m_length_at = packet::header::length;
+    } else if (m_buf.size() > m_max_length) {
+        resync();
+    } else if (m_buf.size() == m_length_at) {
+        checkLength();
+    }
+}
+
+void parser::resync() {
+    if (m_buf.size() > packet::HEADER_LENGTH) {
+        ++m_resyncs;
+        if (m_verbose & VERB_DEBUG) {
+            *m_out << m_name << ": ERROR: Message longer than expected, " << m_buf.size() << " bytes" << endl;
+        }
+        publishStats();
+    }
+
+    m_buf.erase(m_buf.begin(), m_buf.end() - (packet::HEADER_LENGTH - 1));
+    m_max_length = packet::HEADER_LENGTH - 1;
+    m_length_at = 0;
+}
+
+void parser::checkLength() {
+    int type = packet::header::type::get(&m_buf[0]);
+    m_length_at = 0;
+
+    if (type < 0 || type >= packet::MAX_TYPES || !m_handlers[type].length) {
+        return;
+    }
+
+    const msg_handler& h = m_handlers[type];
+    if (h.length_at > m_buf.size()) {
+        m_length_at = h.length_at;
+    } else {
+        m_max_length = min(h.length(&m_buf[0]), h.max_length);
+    }
 }
 
 bool parser::is_header(int pos) {
@@ -100,16 +336,6 @@ bool parser::is_footer(int pos) {
     }
 }
 
-long parser::construct_long(int pos) {
-    long tmp = static_cast<int32_t>(m_buf[pos] | m_buf[pos + 1] << 8 | m_buf[pos + 2] << 16 | m_buf[pos + 3] << 24);
-    return tmp;
-}
-
-int parser::construct_int(int pos) {
-    int tmp = static_cast<int16_t>(m_buf[pos] | m_buf[pos + 1] << 8);
-    return tmp;
-}
-
 bool parser::inBounds(const Mat& mat, int x, int y) {
     return x >= 0 && y >= 0 && x < mat.cols && y < mat.rows;
 }
@@ -147,51 +373,64 @@ Point parser::intersection(const Point& p1, const Point& p2, const Point& p3, co
 void parser::processMsg() {
     // verify header
     if (!is_header(3) && (m_verbose & VERB_DEBUG)) {
-        cerr << "ERRROR: Header does not match" << endl;
+        *m_out << m_name << ": ERROR: Header does not match" << endl;
         return;
     }
 
     // verify footer
     if (!is_footer(m_buf.size() - 1) && (m_verbose & VERB_DEBUG)) {
-        cerr << "ERROR: Footer does not match" << endl;
+        *m_out << m_name << ": ERROR: Footer does not match" << endl;
+        return;
+    }
+
+    if (m_buf.size() < packet::MIN_LENGTH) {
+        if (m_verbose & VERB_DEBUG) {
+            *m_out << m_name << ": ERROR: Message too short" << endl;
+        }
         return;
     }
 
-    // sequence number (increment by one per message)
-    unsigned long timestamp = construct_long(TIMESTAMP);
-    uint16_t seq = construct_int(SEQUENCE);
-    int type = construct_int(TYPE);
+    const unsigned char *msg = &m_buf[0];
+    uint32_t timestamp = packet::header::timestamp::get(msg);
+    m_time += static_cast<uint32_t>(timestamp - m_timestamp);
+    m_timestamp = timestamp;
+    uint16_t seq = packet::header::sequence::get(msg);
+    int type = packet::header::type::get(msg);
     
     if (m_verbose & VERB_DEBUG) {
-        cout << seq << " (" << timestamp << ")\ttype: " << hex << "0x" << type << dec << "\t\t";
-    }
-
-    switch(type) {
-        case POSITION:
-            processOdom();
-            break;
-        case TEXT:
-            processText();
-            break;
-        case MAP:
-            processMap();
-            break;
-        case LASER:
-            processLaser();
-            break;
-        default:
-            /* cout << endl; */
-            break;
+        *m_out << seq << " (" << m_timestamp << ")\ttype: " << hex << "0x" << type << dec << "\t\t";
+    }
+
+    if (type >= 0 && type < packet::MAX_TYPES
+            && (m_handlers[type].method || m_handlers[type].callback)) {
+        const msg_handler& h = m_handlers[type];
+        if (m_buf.size() < h.min_length) {
+            if (m_verbose & VERB_DEBUG) {
+                *m_out << "(short message, " << m_buf.size() << " bytes)";
+            }
+        } else if (h.method) {
+            (this->*h.method)();
+        } else {
+            h.callback(type, msg, m_buf.size(), h.ctx);
+        }
+    } else {
+        processUnknown(type);
     }
 
     if (m_verbose & VERB_DEBUG) {
-        cout << endl;
+        *m_out << endl;
     }
 }
 
 void parser::processOdom() {
+    const unsigned char *msg = &m_buf[0];
+    left.count = packet::odom::left_count::get(msg);
+    right.count = packet::odom::right_count::get(msg);
+    left.speed = packet::odom::left_speed::get(msg) * 0.001;
+    right.speed = packet::odom::right_speed::get(msg) * 0.001;
+
     if (m_verbose & (VERB_ODOM | VERB_DEBUG)) {
-        cout << "(odom, " << (m_buf.size() - 0x0c - 4) << " bytes)\t";
+        *m_out << "(odom, " << (m_buf.size() - 0x0c - 4) << " bytes)\t";
         
         if (m_verbose & VERB_ODOM) {
             // for (int i = 0; i < m_buf.size() - 0x0c - 4; i++) {
@@ -199,74 +438,140 @@ void parser::processOdom() {
             // }
             // cout << endl;
 
-            left.count = construct_long(0x0c); // maybe encoder counts?
-            right.count = construct_long(0x10); // maybe encoder counts?
-            long noclue = construct_long(0x18); // constant at 32000 no clue what this is
-            left.speed = construct_int(0x14) * 0.001; // maybe encoder count rate?
-            right.speed = construct_int(0x16) * 0.001; // maybe encoder count rate?
-            cout << left.count * 0.001 << "\t" << right.count * 0.001 << "\t" << m_center.x << "\t" << m_center.y;
+            *m_out << left.count * 0.001 << "\t" << right.count * 0.001 << "\t" << m_center.x << "\t" << m_center.y;
             if (!(m_verbose & VERB_DEBUG)) {
-                cout << endl;
+                *m_out << endl;
             }
         }
     }
+
+    if (m_publisher) {
+        pub_odom odom;
+        odom.timestamp = m_timestamp;
+        odom.left_count = packet::odom::left_count::get(msg);
+        odom.right_count = packet::odom::right_count::get(msg);
+        odom.left_speed = packet::odom::left_speed::get(msg);
+        odom.right_speed = packet::odom::right_speed::get(msg);
+        m_publisher->publishOdom(odom);
+    }
 }
 
 void parser::processText() {
-    long string_length = construct_long(STR_LEN);
+    long string_length = packet::text::str_length::get(&m_buf[0]);
+
+    // the footer may turn up inside a message, cutting it short
+    if (string_length < 0 || packet::text::length(&m_buf[0]) > m_buf.size()) {
+        if (m_verbose & VERB_DEBUG) {
+            *m_out << "(text, " << string_length << " bytes does not fit in "
+                << m_buf.size() << " byte message)";
+        }
+        return;
+    }
+
     unsigned char *text_buf = new unsigned char[string_length + 1];
 
     if (m_verbose & (VERB_TEXT | VERB_DEBUG)) {
-        cout << "(text, " << string_length << " bytes) ";
+        *m_out << "(text, " << string_length << " bytes) ";
     }
 
     for (int i = 0; i < string_length; i++) {
-        text_buf[i] = m_buf[STR_DATA + i];
+        text_buf[i] = m_buf[packet::text::data + i];
     }
     text_buf[string_length] = '\0';
 
     if (m_verbose & VERB_TEXT) {
-        cout << text_buf;
-        if (text_buf[string_length - 1] != '\n') {
-            cout << endl;
+        *m_out << text_buf;
+        if (string_length == 0 || text_buf[string_length - 1] != '\n') {
+            *m_out << endl;
         }
     }
 
     delete[] text_buf;
 }
 
+void parser::processUnknown(int type) {
+    if (m_unknown.size() < MAX_UNKNOWN || m_unknown.count(type)) {
+        unknown_type& u = m_unknown[type];
+        if (u.count == 0) {
+            u.min_length = m_buf.size();
+            u.max_length = m_buf.size();
+            u.sample.assign(m_buf.begin(), m_buf.begin() + min(m_buf.size(), UNKNOWN_SAMPLE_LENGTH));
+        }
+        ++u.count;
+        u.min_length = min(u.min_length, m_buf.size());
+        u.max_length = max(u.max_length, m_buf.size());
+    } else {
+        ++m_unknown_overflow;
+    }
+
+    if (m_verbose & (VERB_UNKNOWN | VERB_DEBUG)) {
+        *m_out << "(unknown, " << m_buf.size() << " bytes)";
+        if (m_verbose & VERB_UNKNOWN) {
+            for (unsigned int i = packet::header::length; i < m_buf.size() - packet::FOOTER_LENGTH; i++) {
+                *m_out << " " << hex << setw(2) << setfill('0') << static_cast<int>(m_buf[i]) << dec << setfill(' ');
+            }
+        }
+        if (!(m_verbose & VERB_DEBUG)) {
+            *m_out << endl;
+        }
+    }
+}
+
 
 void parser::processMap() {
     fstream file;
     
     // read existing data
     // edit data with new input
-    long size = construct_long(MAP_SIZE);
-    long address = construct_long(MAP_ADDR);
+    long size = packet::map::size::get(&m_buf[0]);
+    long address = packet::map::address::get(&m_buf[0]);
+
+    if (size < 0 || address < 0 || address + size > static_cast<long>(sizeof(m_img))
+            || packet::map::data + size + packet::FOOTER_LENGTH > static_cast<long>(m_buf.size())) {
+        if (m_verbose & VERB_DEBUG) {
+            *m_out << "(map, " << size << " bytes at 0x" << hex << address << dec
+                << " does not fit in the map or the " << m_buf.size() << " byte message)";
+        }
+        return;
+    }
 
     if (m_verbose & (VERB_MAP | VERB_DEBUG)) {
-        cout << "(map, " << size << " bytes at 0x" << hex <<  address << dec << ")";
+        *m_out << "(map, " << size << " bytes at 0x" << hex <<  address << dec << ")";
         if (!(m_verbose & VERB_DEBUG)) {
-            cout << endl;
+            *m_out << endl;
         }
     }
 
-    copy(m_buf.begin() + MAP_DATA, m_buf.begin() + MAP_DATA + size, m_img + address);
+    copy(m_buf.begin() + packet::map::data, m_buf.begin() + packet::map::data + size, m_img + address);
+    m_map.update(address, &m_buf[packet::map::data], size);
 
-    if (m_gui_running) {
+    if (m_publisher) {
+        m_publisher->publishMap(m_timestamp, address, &m_buf[packet::map::data], size,
+                reinterpret_cast<unsigned char *>(m_img));
+    }
+
+    if (m_gui) {
         Mat img(256, 256, CV_8UC1);
         copy(m_img, m_img + 65536, img.data);
-        imshow(m_name, img);
-        waitKey(m_delay_time);
+        m_gui->show(m_name, img);
     }
 
-    Image temp(Geometry(256, 256), Color(0, 0, 0, 0));
+    if (m_keep_map) {
+        Image temp(Geometry(256, 256), Color(0, 0, 0, 0));
 
-    temp.magick("gray");
-    temp.read(256, 256, "I", CharPixel, m_img);
-    temp.animationDelay(1);
-    
-    m_images.push_back(temp);
+        temp.magick("gray");
+        temp.read(256, 256, "I", CharPixel, m_img);
+        temp.animationDelay(1);
+
+        m_images.push_back(temp);
+        m_image_times.push_back(m_time);
+        retain(m_images, m_image_times);
+    }
+    publishStats();
+}
+
+const mapcache& parser::getMap() const {
+    return m_map;
 }
 
 void parser::writeMap(const char *filename) {
@@ -278,23 +583,30 @@ void parser::writeAnim(const char *filename) {
 }
 
 void parser::processLaser() {
-    long index = construct_long(LSR_INDEX);
+    long index = packet::laser::index::get(&m_buf[0]);
     
+    if (index < 0 || index >= 360) {
+        if (m_verbose & VERB_DEBUG) {
+            *m_out << "(laser, bad index " << index << ")";
+        }
+        return;
+    }
+
     if (m_verbose & (VERB_LASER | VERB_DEBUG)) {
-        cout << "(laser, " << index << " deg)\t";
+        *m_out << "(laser, " << index << " deg)\t";
     }
 
     for (int i = 0; i < 90; i++) {
-        laser_unit *u = &m_laser[index + i];
-        u->pt.x = construct_int(LSR_DATA + 4 * i);
-        u->pt.y = construct_int(LSR_DATA + 4 * i + 2);
+        laser_unit *u = &m_laser[(index + i) % 360];
+        u->pt.x = packet::laser::x::get(&m_buf[0], i);
+        u->pt.y = packet::laser::y::get(&m_buf[0], i);
         u->valid = abs(u->pt.x) < 512 && abs(u->pt.y) < 512;
         if (m_verbose & VERB_LASER) {
             if (m_verbose & VERB_DEBUG) {
                 if (u->valid) {
-                    cout << "(" << u->pt.x << ", " << u->pt.y << ")" << endl;
+                    *m_out << "(" << u->pt.x << ", " << u->pt.y << ")" << endl;
                 } else {
-                    cout << "Out of range" << endl;
+                    *m_out << "Out of range" << endl;
                 }
             }
         }
@@ -332,8 +644,9 @@ void parser::processLaser() {
             Point sc[4];
             bool invalid = false;
             for (int j = 0; j < 4; j++) {
-                if (m_laser[i + j * 90].valid) {
-                    sc[j] = convertPoint(img, m_laser[i + j * 90].pt, min, max);
+                const laser_unit& u = m_laser[(i + j * 90) % 360];
+                if (u.valid) {
+                    sc[j] = convertPoint(img, u.pt, min, max);
                 } else {
                     invalid = true;
                 }
@@ -370,7 +683,7 @@ void parser::processLaser() {
                 
                 // this is rather suboptimal =(
                 if (m_verbose & VERB_LASER) {
-                    cout << "Intersection: " << center;
+                    *m_out << "Intersection: " << center;
                 }
 
                 for (int j = -5; j <= 5; j++) {
@@ -386,18 +699,35 @@ void parser::processLaser() {
             }
         }
 
-        Image temp(img.cols, img.rows, "BGR", CharPixel, reinterpret_cast<char*>(img.data));
-        temp.animationDelay(1);
-    
-        m_laser_images.push_back(temp);
+        if (m_publisher) {
+            pub_scan scan;
+            scan.timestamp = m_timestamp;
+            scan.center_x = m_center.x;
+            scan.center_y = m_center.y;
+            for (int i = 0; i < 360; i++) {
+                scan.x[i] = m_laser[i].pt.x;
+                scan.y[i] = m_laser[i].pt.y;
+                scan.valid[i] = m_laser[i].valid;
+            }
+            m_publisher->publishScan(scan);
+        }
+
+        if (m_keep_laser) {
+            Image temp(img.cols, img.rows, "BGR", CharPixel, reinterpret_cast<char*>(img.data));
+            temp.animationDelay(1);
+
+            m_laser_images.push_back(temp);
+            m_laser_times.push_back(m_time);
+            retain(m_laser_images, m_laser_times);
+        }
+        publishStats();
 
-        if (m_gui_running) {
-            imshow("Laser", img);
-            waitKey(m_delay_time);
+        if (m_gui) {
+            m_gui->show(m_laser_name, img);
         }
     }
     
     if (m_verbose & VERB_LASER) {
-        cout << endl;
+        *m_out << endl;
     }
 }
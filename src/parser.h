@@ -16,10 +16,19 @@
  */
 
 #ifndef PARSER_H_
+#define PARSER_H_
 
 #include <vector>
+#include <deque>
+#include <map>
+#include <ostream>
 #include <Magick++.h>
 #include <opencv2/core/core.hpp>
+#include "packet.h"
+#include "publisher.h"
+#include "display.h"
+#include "mapcache.h"
+#include "recorder.h"
 
 using std::vector;
 using std::string;
@@ -33,9 +42,9 @@ public:
     /*!
      * Constructs a parser object
      * @param name Name of the window
-     * @param gui whether or not to show a GUI
+     * @param gui where to show the map and laser, NULL for no GUI
      */
-    parser(const char *name, bool gui = true, int delayTime = 1);
+    parser(const char *name, display *gui = NULL);
 
     /*!
      * Destructs a parser object
@@ -44,9 +53,9 @@ public:
 
     /*!
      * Determines whether or not to use a gui
-     * @param gui use a gui
+     * @param gui where to show the map and laser, NULL for no GUI
      */
-    void setGui(bool gui = true);
+    void setGui(display *gui);
 
     /*!
      * Sets the verbosity of the program
@@ -54,12 +63,76 @@ public:
      */
     void setVerbosity(int verbose);
 
+    /*!
+     * Sets where decoded messages and framing errors are printed; errors
+     * start with the parser's name
+     * @param out the stream to print to, stdout by default
+     */
+    void setOutput(std::ostream& out);
+
+    /*!
+     * Publishes decoded scans, map updates and odometry
+     * @param pub the publisher, or NULL to stop publishing
+     */
+    void setPublisher(publisher *pub);
+
+    /*!
+     * Includes a recorder's buffers in memoryUsage
+     * @param rec the recorder, or NULL
+     */
+    void setRecorder(const recorder *rec);
+
     /*!
      * Call with new characters to get them parsed
      * @param c character to parse
      */
     void update(char c);
 
+    /*!
+     * Call with a block of new characters to get them parsed
+     * @param data characters to parse
+     * @param len number of characters
+     */
+    void update(const char *data, size_t len);
+
+    /*!
+     * Limits how many map and laser frames are kept for writeMap and
+     * writeAnim; older ones are dropped
+     * @param maxFrames frames kept of each, 0 for no limit
+     * @param maxAge seconds of robot time kept, 0 for no limit
+     */
+    void setRetention(size_t maxFrames, double maxAge = 0);
+
+    /*!
+     * Sets whether map and laser frames are made for writeMap and writeAnim
+     * at all; each frame takes 0.5-2 MB, so leave them off unless the gif
+     * will be written. Both are on by default.
+     * @param map keep map frames
+     * @param laser keep laser frames
+     */
+    void keepFrames(bool map, bool laser);
+
+    struct memory_usage {
+        size_t buffer;          // bytes reserved for incoming messages
+        size_t map_frames;
+        size_t laser_frames;
+        size_t image_bytes;     // estimated size of the frames kept
+        size_t map_cache;       // bytes held by the map tile cache
+        unsigned long resyncs;  // messages dropped for being too long
+        size_t capture_bytes;   // held by the recorder, see setRecorder
+        uint64_t capture_dropped;   // input the recorder could not keep up with
+    };
+
+    /*!
+     * @return what the parser is holding on to
+     */
+    memory_usage memoryUsage() const;
+
+    /*!
+     * @return the current map, for writing snapshots of
+     */
+    const mapcache& getMap() const;
+
     /*!
      * Writes a gif map animation
      * @param filename the file to be written
@@ -72,6 +145,54 @@ public:
      */
     void writeAnim(const char *filename);
 
+    /*!
+     * Handles a message of a type registered with registerHandler
+     * @param type the message type
+     * @param msg the whole message, header through footer
+     * @param len the length of the message
+     * @param ctx the context given to registerHandler
+     */
+    typedef void (*msg_callback)(int type, const unsigned char *msg, size_t len, void *ctx);
+
+    /*!
+     * Registers a handler for a message type, replacing the built-in one if
+     * there is one
+     * @param type the message type, less than packet::MAX_TYPES
+     * @param callback the handler, or NULL to treat the type as unknown
+     * @param ctx passed through to the handler
+     * @param minLength shorter messages of this type are dropped
+     * @return false if the type does not fit in the dispatch table
+     */
+    bool registerHandler(int type, msg_callback callback, void *ctx = NULL,
+            size_t minLength = packet::MIN_LENGTH);
+
+    /*!
+     * Registers a handler for the message type described by LAYOUT, a
+     * struct like those in packet.h, replacing the built-in one if there is
+     * one. Messages of the type are framed by the layout's lengths, so one
+     * that runs long is dropped as soon as that is known.
+     * @param callback the handler, or NULL to treat the type as unknown
+     * @param ctx passed through to the handler
+     * @return true
+     */
+    template <typename LAYOUT>
+    bool registerHandler(msg_callback callback, void *ctx = NULL) {
+        if (!callback) {
+            return registerHandler(LAYOUT::id, NULL, ctx);
+        }
+        registerLayout<LAYOUT>(NULL);
+        m_handlers[LAYOUT::id].callback = callback;
+        m_handlers[LAYOUT::id].ctx = ctx;
+        return true;
+    }
+
+    /*!
+     * Writes a summary of the message types without a handler: how often
+     * each was seen, how long they were and the first one received
+     * @param out the stream to write to
+     */
+    void writeUnknown(std::ostream& out);
+
 /* private functions */
 private:
     /*!
@@ -88,6 +209,30 @@ private:
      */
     bool is_footer(int pos);
 
+    /*!
+     * Drops the message being received, keeping only what could be the
+     * start of the next header
+     */
+    void resync();
+
+    /*!
+     * Works out how long the message being received must be once enough of
+     * it is in to tell
+     */
+    void checkLength();
+
+    /*!
+     * Drops the oldest frames until within the retention limits
+     * @param images the frames
+     * @param times when each frame was made
+     */
+    void retain(std::deque<Image>& images, std::deque<uint64_t>& times);
+
+    /*!
+     * Publishes memoryUsage, if publishing
+     */
+    void publishStats();
+
     /*!
      * Processes a message
      */
@@ -114,18 +259,33 @@ private:
     void processLaser();
 
     /*!
-     * Constructs a long, LSB first.
-     * @param pos the position in the message buffer
-     * @return the constructed long
+     * Records a message of a type without a handler
+     * @param type the message type
      */
-    long construct_long(int pos);
+    void processUnknown(int type);
+
+    typedef void (parser::*msg_method)();
 
     /*!
-     * Constructs an int, LSB first.
-     * @param pos the position in the message buffer
-     * @return the constructed int
+     * Registers a built-in handler for the message type described by LAYOUT
+     * @param method the handler, NULL if a callback is set afterwards
      */
-    int construct_int(int pos);
+    template <typename LAYOUT>
+    void registerLayout(msg_method method) {
+        static_assert(LAYOUT::id >= 0 && static_cast<int>(LAYOUT::id) < packet::MAX_TYPES,
+                "message type does not fit in the dispatch table");
+        static_assert(static_cast<int>(LAYOUT::min_length) >= packet::MIN_LENGTH
+                && static_cast<int>(LAYOUT::max_length) <= packet::MAX_LENGTH,
+                "message lengths do not fit the framing");
+        msg_handler& h = m_handlers[LAYOUT::id];
+        h.method = method;
+        h.callback = NULL;
+        h.ctx = NULL;
+        h.min_length = LAYOUT::min_length;
+        h.max_length = LAYOUT::max_length;
+        h.length_at = LAYOUT::length_at;
+        h.length = &LAYOUT::length;
+    }
 
     /*!
      * Checks if a point is in bounds
@@ -157,38 +317,53 @@ private:
      */
     Point intersection(const Point& p1, const Point& p2, const Point& p3, const Point& p4);
 
-    enum MSG_PKT {
-        HEAD        = 0x00,
-        TYPE        = 0x04,
-        SEQUENCE    = 0x06,
-        TIMESTAMP   = 0x08,
-        /* text messages */
-        STR_LEN     = 0x0c,
-        STR_DATA    = 0x10,
-        /* laser */
-        LSR_INDEX   = 0x10,
-        LSR_DATA    = 0x14,
-        /* map */
-        MAP_SIZE    = 0x0c,
-        MAP_ADDR    = 0x10,
-        MAP_DATA    = 0x18,
-        /* odom */
+    struct msg_handler {
+        msg_method method;      // built-in handler, or
+        msg_callback callback;  // registered handler
+        void *ctx;
+        size_t min_length;
+        size_t max_length;
+        size_t length_at;   // bytes needed before length can be called
+        size_t (*length)(const unsigned char *msg); // NULL if not known
     };
 
-    enum MSG_TYPES {
-        POSITION    = 0x01,
-        LASER       = 0x05,
-        MAP         = 0x09,
-        TEXT        = 0x11,
+    msg_handler m_handlers[packet::MAX_TYPES];
+
+    struct unknown_type {
+        unsigned long count;
+        size_t min_length;
+        size_t max_length;
+        vector<unsigned char> sample;   // the first message seen
     };
 
+    std::map<int, unknown_type> m_unknown;
+    unsigned long m_unknown_overflow;   // messages of types past MAX_UNKNOWN
+
     char m_img[65536];
-    vector<Image> m_images;
-    vector<Image> m_laser_images;
+    mapcache m_map;
+    std::deque<Image> m_images;
+    std::deque<uint64_t> m_image_times;
+    std::deque<Image> m_laser_images;
+    std::deque<uint64_t> m_laser_times;
+    size_t m_max_frames;
+    uint64_t m_max_age;
+    bool m_keep_map;
+    bool m_keep_laser;
+
     vector<unsigned char> m_buf;
+    size_t m_max_length;    // drop the message if it gets longer than this
+    size_t m_length_at;     // call checkLength at this length, 0 if done
+    unsigned long m_resyncs;
     string m_name;
+    string m_laser_name;
+    std::ostream *m_out;
+    publisher *m_publisher;
+    const recorder *m_recorder;
+
+    uint32_t m_timestamp;   // of the message being processed
+    uint64_t m_time;        // m_timestamp, without wrapping
 
-    bool m_gui_running;
+    display *m_gui;
 
     struct laser_unit {
         Point pt;
@@ -214,11 +389,11 @@ public:
         VERB_LASER  = (1 << 2),
         VERB_MAP    = (1 << 3),
         VERB_ODOM   = (1 << 4),
+        VERB_UNKNOWN= (1 << 5),
     };
 private:
 
     int m_verbose;
-    int m_delay_time;
 };
 
 #endif /* PARSER_H_ */
@@ -0,0 +1,200 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "publisher.h"
+#include <iostream>
+#include <new>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+using namespace std;
+
+publisher::publisher() : m_shm(NULL), m_listen_fd(-1), m_seq(0) {
+}
+
+publisher::~publisher() {
+    close();
+}
+
+bool publisher::open(const string& name) {
+    close();
+
+    m_shm_name = "/" + name;
+    m_socket_path = "/tmp/" + name + ".sock";
+
+    int fd = shm_open(m_shm_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        cerr << "Could not create shared memory " << m_shm_name << endl;
+        return false;
+    }
+    if (ftruncate(fd, sizeof(pub_shm)) < 0) {
+        cerr << "Could not size shared memory " << m_shm_name << endl;
+        ::close(fd);
+        shm_unlink(m_shm_name.c_str());
+        return false;
+    }
+    void *mem = mmap(NULL, sizeof(pub_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        cerr << "Could not map shared memory " << m_shm_name << endl;
+        shm_unlink(m_shm_name.c_str());
+        return false;
+    }
+
+    // the object was just truncated, so everything including the sequence
+    // counters starts out zero
+    m_shm = new (mem) pub_shm;
+    m_shm->magic = PUB_MAGIC;
+    m_shm->version = PUB_VERSION;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (m_socket_path.size() >= sizeof(addr.sun_path)) {
+        cerr << "Socket path too long: " << m_socket_path << endl;
+        close();
+        return false;
+    }
+    strcpy(addr.sun_path, m_socket_path.c_str());
+    unlink(m_socket_path.c_str());
+
+    m_listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listen_fd < 0
+            || bind(m_listen_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0
+            || listen(m_listen_fd, 8) < 0) {
+        cerr << "Could not listen on " << m_socket_path << endl;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void publisher::close() {
+    for (unsigned int i = 0; i < m_subscribers.size(); i++) {
+        ::close(m_subscribers[i]);
+    }
+    m_subscribers.clear();
+
+    if (m_listen_fd >= 0) {
+        ::close(m_listen_fd);
+        m_listen_fd = -1;
+        unlink(m_socket_path.c_str());
+    }
+
+    if (m_shm) {
+        munmap(m_shm, sizeof(pub_shm));
+        m_shm = NULL;
+        shm_unlink(m_shm_name.c_str());
+    }
+}
+
+bool publisher::isOpen() const {
+    return m_shm != NULL;
+}
+
+void publisher::publishScan(const pub_scan& scan) {
+    if (!m_shm) {
+        return;
+    }
+    writeSlot(m_shm->scan, scan);
+    send(PUB_SCAN, &scan, sizeof(scan));
+}
+
+void publisher::publishMap(uint32_t timestamp, uint32_t address, const unsigned char *data,
+        uint32_t size, const unsigned char *map) {
+    if (!m_shm) {
+        return;
+    }
+
+    // written in place rather than through writeSlot to avoid building a
+    // second 64k copy of the map
+    pub_slot<pub_map>& slot = m_shm->map;
+    uint32_t seq = slot.seq.load(memory_order_relaxed);
+    slot.seq.store(seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot.data.timestamp = timestamp;
+    memcpy(slot.data.pixels, map, sizeof(slot.data.pixels));
+    slot.seq.store(seq + 2, memory_order_release);
+
+    pub_map_chunk chunk;
+    chunk.timestamp = timestamp;
+    chunk.address = address;
+    chunk.size = size;
+    send(PUB_MAP, &chunk, sizeof(chunk), data, size);
+}
+
+void publisher::publishOdom(const pub_odom& odom) {
+    if (!m_shm) {
+        return;
+    }
+    writeSlot(m_shm->odom, odom);
+    send(PUB_ODOM, &odom, sizeof(odom));
+}
+
+void publisher::publishStats(const pub_stats& stats) {
+    if (!m_shm) {
+        return;
+    }
+    writeSlot(m_shm->stats, stats);
+}
+
+void publisher::acceptSubscribers() {
+    int fd;
+    while ((fd = accept4(m_listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        m_subscribers.push_back(fd);
+    }
+}
+
+void publisher::send(PUB_KIND kind, const void *data, size_t len, const void *extra, size_t extraLen) {
+    acceptSubscribers();
+
+    pub_header header;
+    header.kind = kind;
+    header.seq = m_seq++;
+
+    struct iovec iov[3];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = const_cast<void *>(data);
+    iov[1].iov_len = len;
+    iov[2].iov_base = const_cast<void *>(extra);
+    iov[2].iov_len = extraLen;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = extra ? 3 : 2;
+
+    for (unsigned int i = 0; i < m_subscribers.size(); ) {
+        // seqpacket sends are all or nothing, so a full socket just means this
+        // subscriber misses the message
+        if (sendmsg(m_subscribers[i], &msg, MSG_DONTWAIT | MSG_NOSIGNAL) < 0
+                && errno != EAGAIN && errno != EWOULDBLOCK) {
+            ::close(m_subscribers[i]);
+            m_subscribers.erase(m_subscribers.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
@@ -0,0 +1,266 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PUBLISHER_H_
+#define PUBLISHER_H_
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <inttypes.h>
+
+using std::string;
+using std::vector;
+
+/*
+ * Decoded data shared with other local processes, in two ways:
+ *
+ * - a shared memory object (shm_open) holding the latest complete scan, map,
+ *   odometry and memory usage, each guarded by a sequence counter so readers
+ *   never see a half written value and never block the writer (see readSlot);
+ * - a SOCK_SEQPACKET unix socket that every subscriber connected to gets
+ *   each message on, as a pub_header followed by the payload. Subscribers
+ *   that fall behind miss messages rather than slowing the parser down.
+ *
+ * Consumers only need this header.
+ */
+
+enum {
+    PUB_MAGIC       = 0x31315658,   // "XV11"
+    PUB_VERSION     = 4,
+    PUB_SCAN_POINTS = 360,
+    PUB_MAP_SIZE    = 256,
+};
+
+enum PUB_KIND {
+    PUB_SCAN        = 1,    // pub_scan
+    PUB_MAP         = 2,    // pub_map_chunk followed by size bytes of map
+    PUB_ODOM        = 3,    // pub_odom
+};
+
+/*!
+ * Starts every message on the socket
+ */
+struct pub_header {
+    uint32_t kind;      // PUB_KIND
+    uint32_t seq;       // counts every message published on this socket
+};
+
+/*!
+ * One complete laser revolution
+ */
+struct pub_scan {
+    uint32_t timestamp;
+    int16_t center_x;
+    int16_t center_y;
+    int16_t x[PUB_SCAN_POINTS];
+    int16_t y[PUB_SCAN_POINTS];
+    uint8_t valid[PUB_SCAN_POINTS];
+};
+
+/*!
+ * A map update as received from the robot; the full map is in shared memory
+ */
+struct pub_map_chunk {
+    uint32_t timestamp;
+    uint32_t address;
+    uint32_t size;
+};
+
+/*!
+ * The whole map
+ */
+struct pub_map {
+    uint32_t timestamp;
+    uint8_t pixels[PUB_MAP_SIZE * PUB_MAP_SIZE];
+};
+
+/*!
+ * Wheel odometry
+ */
+struct pub_odom {
+    uint32_t timestamp;
+    int32_t left_count;
+    int32_t right_count;
+    int16_t left_speed;
+    int16_t right_speed;
+};
+
+/*!
+ * What the parser is holding on to, see parser::memoryUsage
+ */
+struct pub_stats {
+    uint64_t buffer_bytes;
+    uint64_t image_bytes;
+    uint32_t map_frames;
+    uint32_t laser_frames;
+    uint32_t resyncs;
+    uint64_t capture_bytes;
+    uint64_t capture_dropped;
+    uint64_t map_cache_bytes;
+};
+
+/*!
+ * A value guarded by a sequence counter. The counter is odd while the value
+ * is being written.
+ */
+template <typename T>
+struct pub_slot {
+    std::atomic<uint32_t> seq;
+    T data;
+};
+
+/*!
+ * Layout of the shared memory object
+ */
+struct pub_shm {
+    uint32_t magic;
+    uint32_t version;
+    pub_slot<pub_scan> scan;
+    pub_slot<pub_map> map;
+    pub_slot<pub_odom> odom;
+    pub_slot<pub_stats> stats;
+};
+
+/*!
+ * Copies the latest value out of a slot, retrying while it is being written
+ * @param slot the slot to read
+ * @param out where to copy the value
+ * @return the slot's sequence number, 0 if nothing was ever published
+ */
+template <typename T>
+uint32_t readSlot(const pub_slot<T>& slot, T& out) {
+    for (;;) {
+        uint32_t before = slot.seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        memcpy(&out, &slot.data, sizeof(T));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) == before) {
+            return before / 2;
+        }
+    }
+}
+
+/*
+ * Writing side of the above, owned by the process running the parser.
+ */
+class publisher {
+/* public functions */
+public:
+    /*!
+     * Constructs a closed publisher
+     */
+    publisher();
+
+    /*!
+     * Closes the publisher, removing its shared memory and socket
+     */
+    virtual ~publisher();
+
+    /*!
+     * Creates the shared memory object and the listening socket
+     * @param name shared memory is /name, the socket /tmp/name.sock
+     * @return true if successful
+     */
+    bool open(const string& name);
+
+    /*!
+     * Closes everything and removes the shared memory and socket
+     */
+    void close();
+
+    /*!
+     * @return true if open
+     */
+    bool isOpen() const;
+
+    /*!
+     * Publishes a complete laser revolution
+     * @param scan the revolution
+     */
+    void publishScan(const pub_scan& scan);
+
+    /*!
+     * Publishes a map update
+     * @param timestamp when the update was received
+     * @param address where in the map the update starts
+     * @param data the new pixels
+     * @param size number of new pixels
+     * @param map the whole map after the update
+     */
+    void publishMap(uint32_t timestamp, uint32_t address, const unsigned char *data,
+            uint32_t size, const unsigned char *map);
+
+    /*!
+     * Publishes odometry
+     * @param odom the odometry
+     */
+    void publishOdom(const pub_odom& odom);
+
+    /*!
+     * Updates the memory usage gauge; this only goes to shared memory
+     * @param stats the memory usage
+     */
+    void publishStats(const pub_stats& stats);
+
+/* private functions */
+private:
+    /*!
+     * Copies a value into a slot
+     * @param slot the slot to write
+     * @param data the value
+     */
+    template <typename T>
+    void writeSlot(pub_slot<T>& slot, const T& data) {
+        uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+        slot.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&slot.data, &data, sizeof(T));
+        slot.seq.store(seq + 2, std::memory_order_release);
+    }
+
+    /*!
+     * Accepts any subscribers waiting to connect
+     */
+    void acceptSubscribers();
+
+    /*!
+     * Sends a message to every subscriber
+     * @param kind the kind of message
+     * @param data the payload
+     * @param len the length of the payload
+     * @param extra optional trailing data
+     * @param extraLen the length of the trailing data
+     */
+    void send(PUB_KIND kind, const void *data, size_t len,
+            const void *extra = NULL, size_t extraLen = 0);
+
+    publisher(const publisher&);
+    publisher& operator=(const publisher&);
+
+    string m_shm_name;
+    string m_socket_path;
+    pub_shm *m_shm;
+    int m_listen_fd;
+    vector<int> m_subscribers;
+    uint32_t m_seq;
+};
+
+#endif /* PUBLISHER_H_ */
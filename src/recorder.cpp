@@ -0,0 +1,274 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "recorder.h"
+#include "signals.h"
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+using namespace std;
+
+recorder::recorder()
+    : m_rotate_size(0), m_file_index(0), m_fd(-1), m_idx_fd(-1), m_offset(0),
+      m_active(NULL), m_batches(0), m_dropped(0), m_stop(false) {
+}
+
+recorder::~recorder() {
+    close();
+}
+
+bool recorder::open(const string& prefix, uint64_t rotateSize) {
+    close();
+
+    m_prefix = prefix;
+    m_rotate_size = rotateSize;
+    m_file_index = 0;
+    m_offset = 0;
+    if (!openFile()) {
+        cerr << "Could not open a capture file for " << m_prefix << endl;
+        return false;
+    }
+
+    m_active = new batch;
+    m_active->data.reserve(BATCH_SIZE);
+    m_active->rotate = false;
+    m_batches = 1;
+    m_dropped = 0;
+    m_stop = false;
+    m_thread = std::thread(&recorder::writer, this);
+    return true;
+}
+
+void recorder::close() {
+    {
+        lock_guard<mutex> lk(m_lock);
+        if (!m_active) {
+            return;
+        }
+        // no batch is needed to replace it, so this works when all are full
+        m_active->rotate = false;
+        m_full.push_back(m_active);
+        m_active = NULL;
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        ::close(m_idx_fd);
+        m_fd = -1;
+        m_idx_fd = -1;
+    }
+
+    for (unsigned int i = 0; i < m_free.size(); i++) {
+        delete m_free[i];
+    }
+    m_free.clear();
+    m_batches = 0;
+}
+
+bool recorder::isOpen() const {
+    return m_active != NULL;
+}
+
+void recorder::append(const char *data, size_t len) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    lock_guard<mutex> lk(m_lock);
+    if (!m_active) {
+        return;
+    }
+
+    if (m_rotate_size && m_offset > 0 && m_offset + len > m_rotate_size) {
+        if (!seal(true)) {
+            m_dropped += len;
+            return;
+        }
+        m_offset = 0;
+    } else if (!m_active->data.empty() && m_active->data.size() + len > BATCH_SIZE) {
+        if (!seal(false)) {
+            m_dropped += len;
+            return;
+        }
+    }
+
+    capture_chunk chunk;
+    chunk.offset = m_offset;
+    chunk.time = now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+    m_active->chunks.push_back(chunk);
+    m_active->data.insert(m_active->data.end(), data, data + len);
+    m_offset += len;
+}
+
+size_t recorder::bufferSize() const {
+    lock_guard<mutex> lk(m_lock);
+    return static_cast<size_t>(m_batches) * BATCH_SIZE;
+}
+
+uint64_t recorder::dropped() const {
+    lock_guard<mutex> lk(m_lock);
+    return m_dropped;
+}
+
+bool recorder::seal(bool rotate) {
+    batch *next;
+    if (!m_free.empty()) {
+        next = m_free.back();
+        m_free.pop_back();
+    } else if (m_batches < MAX_BATCHES) {
+        next = new batch;
+        next->data.reserve(BATCH_SIZE);
+        m_batches++;
+    } else {
+        return false;
+    }
+
+    m_active->rotate = rotate;
+    m_full.push_back(m_active);
+    m_active = next;
+    m_active->rotate = false;
+
+    m_wake.notify_one();
+    return true;
+}
+
+void recorder::writer() {
+    blockSignals();
+
+    unique_lock<mutex> lk(m_lock);
+    bool failing = false;   // reported, and not yet written since
+
+    for (;;) {
+        if (m_full.empty()) {
+            if (m_stop) {
+                break;
+            }
+            // nothing full yet; flush what there is every so often so that
+            // a slow input still reaches the disk
+            if (!m_wake.wait_for(lk, chrono::milliseconds(FLUSH_INTERVAL),
+                        [this] { return !m_full.empty() || m_stop; })
+                    && !m_active->data.empty()) {
+                seal(false);
+            }
+            continue;
+        }
+
+        batch *b = m_full.front();
+        m_full.erase(m_full.begin());
+        lk.unlock();
+
+        // the next file failed to open at the last rotation; try again
+        if (m_fd < 0 && !openFile() && !failing) {
+            cerr << "Could not open a capture file for " << m_prefix << endl;
+            failing = true;
+        }
+
+        bool written = false;
+        if (m_fd >= 0 && !b->data.empty()) {
+            // offsets are of where the batch really lands, in case earlier
+            // ones were lost
+            off_t pos = lseek(m_fd, 0, SEEK_CUR);
+            uint64_t first = b->chunks.front().offset;
+            for (unsigned int i = 0; i < b->chunks.size(); i++) {
+                b->chunks[i].offset += pos - first;
+            }
+
+            written = writeAll(m_fd, b->data.data(), b->data.size())
+                && writeAll(m_idx_fd, b->chunks.data(), b->chunks.size() * sizeof(capture_chunk));
+            if (!written && !failing) {
+                cerr << "Could not write capture " << m_prefix << ": " << strerror(errno) << endl;
+            }
+            failing = !written;
+        } else if (m_fd >= 0) {
+            written = true;
+        }
+
+        if (b->rotate && m_fd >= 0) {
+            ::close(m_fd);
+            ::close(m_idx_fd);
+            m_fd = -1;
+            m_idx_fd = -1;
+            if (!openFile()) {
+                cerr << "Could not open a capture file for " << m_prefix << endl;
+                failing = true;
+            }
+        }
+
+        size_t lost = written ? 0 : b->data.size();
+        b->data.clear();
+        b->chunks.clear();
+
+        lk.lock();
+        m_dropped += lost;
+        m_free.push_back(b);
+    }
+}
+
+bool recorder::openFile() {
+    char name[32];
+
+    // find the first capture not already on disk, so a restart never
+    // overwrites an earlier run
+    for (; m_file_index < 10000; m_file_index++) {
+        snprintf(name, sizeof(name), ".%04u", m_file_index);
+        string filename = m_prefix + name;
+
+        m_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (m_fd < 0) {
+            if (errno == EEXIST) {
+                continue;
+            }
+            break;
+        }
+
+        m_idx_fd = ::open((filename + ".idx").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (m_idx_fd < 0) {
+            ::close(m_fd);
+            m_fd = -1;
+            break;
+        }
+
+        m_file_index++;
+        return true;
+    }
+
+    return false;
+}
+
+bool recorder::writeAll(int fd, const void *data, size_t len) {
+    const char *p = static_cast<const char *>(data);
+    while (len > 0) {
+        ssize_t written = write(fd, p, len);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += written;
+        len -= written;
+    }
+    return true;
+}
@@ -0,0 +1,164 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <inttypes.h>
+
+using std::string;
+using std::vector;
+
+/*!
+ * Index record written for every chunk of recorded input
+ */
+struct capture_chunk {
+    uint64_t offset;    // of the chunk in the capture file
+    uint64_t time;      // when it was read, microseconds since the epoch
+};
+
+/*
+ * Tees raw input to capture files that can be replayed with -f. Captures are
+ * named prefix.0000, prefix.0001, ... starting at the first unused number,
+ * and each has a prefix.NNNN.idx next to it holding a capture_chunk for
+ * every block of input.
+ *
+ * append only copies into a batch; full batches, and partial ones once a
+ * second, are written out by a separate thread so the decode path never waits
+ * on the disk. If the disk stalls, at most MAX_BATCHES batches are held and
+ * further input is dropped and counted instead.
+ */
+class recorder {
+/* public functions */
+public:
+    /*!
+     * Constructs a closed recorder
+     */
+    recorder();
+
+    /*!
+     * Writes out everything recorded and closes the capture
+     */
+    virtual ~recorder();
+
+    /*!
+     * Opens the first capture file and starts the writer thread
+     * @param prefix path prefix of the capture files
+     * @param rotateSize start a new capture file after this many bytes, 0
+     * to never rotate
+     * @return true if successful
+     */
+    bool open(const string& prefix, uint64_t rotateSize = 0);
+
+    /*!
+     * Writes out everything recorded and closes the capture
+     */
+    void close();
+
+    /*!
+     * @return true if open
+     */
+    bool isOpen() const;
+
+    /*!
+     * Records a block of input
+     * @param data the input
+     * @param len number of bytes
+     */
+    void append(const char *data, size_t len);
+
+    /*!
+     * @return bytes held in batches, written or not
+     */
+    size_t bufferSize() const;
+
+    /*!
+     * @return bytes of input left out of the capture, because the disk
+     * could not keep up or writing or opening a capture file failed
+     */
+    uint64_t dropped() const;
+
+/* private functions */
+private:
+    struct batch {
+        vector<char> data;
+        vector<capture_chunk> chunks;
+        bool rotate;    // start a new file after this batch
+    };
+
+    /*!
+     * Writer thread: writes out sealed batches until closed
+     */
+    void writer();
+
+    /*!
+     * Hands the batch being filled to the writer. Call with m_lock held.
+     * @param rotate start a new file after it
+     * @return false if every batch is already waiting for the writer, in
+     * which case the batch is kept
+     */
+    bool seal(bool rotate);
+
+    /*!
+     * Opens the next unused capture file and its index
+     * @return true if successful
+     */
+    bool openFile();
+
+    /*!
+     * Writes a whole buffer, retrying short writes
+     * @param fd the file to write to
+     * @param data the buffer
+     * @param len its length
+     * @return true if successful
+     */
+    static bool writeAll(int fd, const void *data, size_t len);
+
+    recorder(const recorder&);
+    recorder& operator=(const recorder&);
+
+    enum {
+        BATCH_SIZE      = 1 << 20,
+        MAX_BATCHES     = 16,   // input is dropped rather than buffer more
+        FLUSH_INTERVAL  = 1000, // ms
+    };
+
+    string m_prefix;
+    uint64_t m_rotate_size;
+    unsigned int m_file_index;
+    int m_fd;
+    int m_idx_fd;
+
+    uint64_t m_offset;  // bytes appended to the current file so far
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_wake;
+    batch *m_active;            // being filled by append
+    vector<batch *> m_full;     // waiting for the writer
+    vector<batch *> m_free;     // written, ready for reuse
+    unsigned int m_batches;     // allocated, at most MAX_BATCHES
+    uint64_t m_dropped;
+    bool m_stop;
+    std::thread m_thread;
+};
+
+#endif /* RECORDER_H_ */
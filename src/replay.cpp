@@ -0,0 +1,156 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay.h"
+#include <algorithm>
+#include <time.h>
+
+using namespace std;
+
+replay::replay()
+    : m_speed(0), m_pos(0), m_scan(0), m_finished(false),
+      m_scheduled(false), m_next_end(0), m_next_due(0),
+      m_anchored(false), m_start(0), m_last_timestamp(0), m_elapsed(0) {
+}
+
+void replay::setSpeed(double speed) {
+    m_speed = speed;
+}
+
+void replay::push(const char *data, size_t len) {
+    m_buf.insert(m_buf.end(), reinterpret_cast<const unsigned char *>(data),
+            reinterpret_cast<const unsigned char *>(data) + len);
+}
+
+void replay::finish() {
+    m_finished = true;
+}
+
+size_t replay::release(parser& p) {
+    size_t released = 0;
+
+    if (m_speed <= 0) {
+        released = m_buf.size() - m_pos;
+        if (released) {
+            p.update(reinterpret_cast<const char *>(&m_buf[m_pos]), released);
+        }
+        m_buf.clear();
+        m_pos = 0;
+        m_scan = 0;
+        return released;
+    }
+
+    int64_t t = now();
+    while (schedule() && m_next_due <= t + SLACK) {
+        p.update(reinterpret_cast<const char *>(&m_buf[m_pos]), m_next_end - m_pos);
+        released += m_next_end - m_pos;
+        m_pos = m_next_end;
+        m_scheduled = false;
+    }
+
+    // a partial message at the end of the input will never complete
+    if (m_finished && !m_scheduled && m_pos < m_buf.size()) {
+        p.update(reinterpret_cast<const char *>(&m_buf[m_pos]), m_buf.size() - m_pos);
+        released += m_buf.size() - m_pos;
+        m_pos = m_buf.size();
+    }
+
+    // no footer in a whole buffer's worth, which no message is that long;
+    // pass it on rather than buffer until one turns up, keeping what could
+    // be the start of a footer
+    if (!m_finished && !m_scheduled && m_buf.size() - m_pos >= BUFFER_AHEAD) {
+        size_t end = m_buf.size() - (packet::FOOTER_LENGTH - 1);
+        p.update(reinterpret_cast<const char *>(&m_buf[m_pos]), end - m_pos);
+        released += end - m_pos;
+        m_pos = end;
+    }
+
+    if (m_pos >= BUFFER_AHEAD || m_pos == m_buf.size()) {
+        m_buf.erase(m_buf.begin(), m_buf.begin() + m_pos);
+        m_scan -= min(m_scan, m_pos);
+        m_next_end -= min(m_next_end, m_pos);
+        m_pos = 0;
+    }
+    return released;
+}
+
+bool replay::wantsMore() const {
+    return !m_finished && (m_speed <= 0 || !m_scheduled || m_buf.size() - m_pos < BUFFER_AHEAD);
+}
+
+bool replay::empty() const {
+    return m_pos >= m_buf.size();
+}
+
+int64_t replay::wait() const {
+    if (m_speed <= 0 || (m_finished && !m_scheduled)) {
+        return empty() ? -1 : 0;
+    }
+    if (!m_scheduled) {
+        return -1;
+    }
+    int64_t w = m_next_due - now();
+    return w > 0 ? w : 0;
+}
+
+bool replay::schedule() {
+    if (m_scheduled) {
+        return true;
+    }
+
+    vector<unsigned char>::iterator begin = m_buf.begin() + max(m_scan, m_pos);
+    vector<unsigned char>::iterator footer = search(begin, m_buf.end(),
+            packet::FOOTER, packet::FOOTER + packet::FOOTER_LENGTH);
+    if (footer == m_buf.end()) {
+        // the end of the buffer could hold the start of a footer
+        m_scan = max(m_pos, m_buf.size() - min(m_buf.size(), static_cast<size_t>(packet::FOOTER_LENGTH - 1)));
+        return false;
+    }
+    m_next_end = footer - m_buf.begin() + packet::FOOTER_LENGTH;
+    m_scan = m_next_end;
+    m_scheduled = true;
+
+    // the message starts at the last header before its footer
+    vector<unsigned char>::iterator header = find_end(m_buf.begin() + m_pos, footer,
+            packet::HEADER, packet::HEADER + packet::HEADER_LENGTH);
+    if (header == footer || footer - header < packet::header::length) {
+        // not a message; release it along with whatever came before
+        return true;
+    }
+
+    uint32_t timestamp = packet::header::timestamp::get(&*header);
+    if (!m_anchored) {
+        m_anchored = true;
+        m_start = now();
+        m_elapsed = 0;
+    } else {
+        // the robot's clock wraps and resets; don't wait out a jump
+        uint32_t delta = timestamp - m_last_timestamp;
+        if (delta <= MAX_GAP) {
+            m_elapsed += delta;
+        }
+    }
+    m_last_timestamp = timestamp;
+    m_next_due = m_start + static_cast<int64_t>(m_elapsed * 1000.0 / m_speed);
+    return true;
+}
+
+int64_t replay::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
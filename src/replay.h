@@ -0,0 +1,125 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <vector>
+#include <inttypes.h>
+#include "parser.h"
+
+using std::vector;
+
+/*
+ * Paces a dump file by the timestamps in its messages. Input is pushed in as
+ * it is read and handed to the parser a whole message at a time once the
+ * message is due, speed times faster than the robot sent it. Messages due
+ * within a millisecond of each other are handed over together, so the caller
+ * wakes up once per batch rather than once per message.
+ *
+ * At speed 0 everything is passed straight through. Otherwise at most
+ * BUFFER_AHEAD bytes are held: input without a footer in that long cannot be
+ * a message and is passed straight through too.
+ */
+class replay {
+/* public functions */
+public:
+    /*!
+     * Constructs an unthrottled replay
+     */
+    replay();
+
+    /*!
+     * Sets how fast to replay
+     * @param speed multiple of real time, 0 for as fast as possible
+     */
+    void setSpeed(double speed);
+
+    /*!
+     * Takes in newly read input
+     * @param data the input
+     * @param len number of bytes
+     */
+    void push(const char *data, size_t len);
+
+    /*!
+     * Marks the end of the input; whatever is left is released right away
+     */
+    void finish();
+
+    /*!
+     * Hands the parser everything that is due
+     * @param p the parser
+     * @return number of bytes handed over
+     */
+    size_t release(parser& p);
+
+    /*!
+     * @return true if more input should be pushed before the next release
+     */
+    bool wantsMore() const;
+
+    /*!
+     * @return true if nothing is left to release
+     */
+    bool empty() const;
+
+    /*!
+     * @return nanoseconds until the next message is due, 0 if one is due
+     * already, -1 if none is buffered
+     */
+    int64_t wait() const;
+
+/* private functions */
+private:
+    /*!
+     * Finds the next whole message and works out when it is due
+     * @return true if there is one
+     */
+    bool schedule();
+
+    /*!
+     * @return CLOCK_MONOTONIC in nanoseconds
+     */
+    static int64_t now();
+
+    enum {
+        BUFFER_AHEAD    = 1 << 17,  // bytes to keep buffered when throttled
+        MAX_GAP         = 10000000, // robot time jumps longer than this are skipped
+        SLACK           = 1000000,  // ns a message may be released early
+    };
+
+    static_assert(static_cast<int>(BUFFER_AHEAD) > static_cast<int>(packet::MAX_LENGTH),
+            "a whole message must fit in the buffer to be paced");
+
+    double m_speed;
+    vector<unsigned char> m_buf;
+    size_t m_pos;           // first byte not yet released
+    size_t m_scan;          // where to continue looking for a footer
+    bool m_finished;
+
+    bool m_scheduled;       // m_next_end and m_next_due are valid
+    size_t m_next_end;      // end of the next message
+    int64_t m_next_due;     // when it is due, CLOCK_MONOTONIC ns
+
+    bool m_anchored;        // m_start and m_last_timestamp are valid
+    int64_t m_start;        // when the first message was released
+    uint32_t m_last_timestamp;
+    uint64_t m_elapsed;     // robot time since the first message
+};
+
+#endif /* REPLAY_H_ */
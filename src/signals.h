@@ -0,0 +1,28 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIGNALS_H_
+#define SIGNALS_H_
+
+/*!
+ * Blocks every signal in the calling thread. Worker threads call this first
+ * thing, so SIGINT and SIGUSR1 are delivered to the main thread, which waits
+ * on them.
+ */
+void blockSignals();
+
+#endif /* SIGNALS_H_ */
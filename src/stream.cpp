@@ -0,0 +1,177 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stream.h"
+#include <iostream>
+#include <unistd.h>
+#include <termios.h>
+#include <fcntl.h>
+#include <string.h>
+
+using namespace std;
+
+static const char *activation_cmd = "SetStreamFormat packet\r\n";
+
+stream::stream(const char *path, bool serial)
+    : m_path(path), m_serial(serial), m_fd(-1), m_eof(false), m_parser(path) {
+}
+
+stream::~stream() {
+    close();
+}
+
+bool stream::open() {
+    if (m_serial) {
+        m_fd = ::open(m_path.c_str(), O_RDWR | O_NONBLOCK | O_NOCTTY);
+    } else {
+        m_fd = ::open(m_path.c_str(), O_RDONLY);
+    }
+
+    if (m_fd < 0) {
+        return false;
+    }
+
+    if (m_serial && !setupSerial()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void stream::close() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool stream::setupSerial() {
+    struct termios tty_opt;
+
+    memset(&tty_opt, 0, sizeof(tty_opt));
+
+    tty_opt.c_cflag = CS8 | CLOCAL | CREAD; // 8N1
+    tty_opt.c_iflag = 0;
+    tty_opt.c_oflag = 0;
+    tty_opt.c_lflag = 0; // noncanonical mode
+    tty_opt.c_cc[VMIN] = 1; // one char is enough
+    tty_opt.c_cc[VTIME] = 0; // no timer
+
+    cfsetospeed(&tty_opt, B115200); // 115200 baud
+    cfsetispeed(&tty_opt, B115200); // 115200 baud
+
+    tcsetattr(m_fd, TCSANOW, &tty_opt);
+
+    if (write(m_fd, activation_cmd, strlen(activation_cmd)) <= 0) {
+        cerr << "Couldn't write activation command to " << m_path << endl;
+        return false;
+    }
+    return true;
+}
+
+bool stream::openLog(const string& filename) {
+    m_log.open(filename.c_str(), ios::out | ios::app);
+    if (!m_log.is_open()) {
+        return false;
+    }
+    m_parser.setOutput(m_log);
+    return true;
+}
+
+bool stream::publish(const string& name) {
+    if (!m_publisher.open(name)) {
+        return false;
+    }
+    m_parser.setPublisher(&m_publisher);
+    return true;
+}
+
+bool stream::record(const string& prefix, uint64_t rotateSize) {
+    if (!m_recorder.open(prefix, rotateSize)) {
+        return false;
+    }
+    m_parser.setRecorder(&m_recorder);
+    return true;
+}
+
+void stream::setSpeed(double speed) {
+    m_replay.setSpeed(speed);
+}
+
+ssize_t stream::pump() {
+    char buf[READ_SIZE];
+
+    if (m_serial) {
+        ssize_t len = read(m_fd, buf, sizeof(buf));
+        if (len > 0) {
+            m_recorder.append(buf, len);
+            m_parser.update(buf, len);
+        }
+        return len;
+    }
+
+    if (!m_eof && m_replay.wantsMore()) {
+        ssize_t len = read(m_fd, buf, sizeof(buf));
+        if (len < 0) {
+            return len;
+        } else if (len == 0) {
+            m_eof = true;
+            m_replay.finish();
+        } else {
+            m_recorder.append(buf, len);
+            m_replay.push(buf, len);
+        }
+    }
+
+    m_replay.release(m_parser);
+    return (m_eof && m_replay.empty()) ? 0 : 1;
+}
+
+int64_t stream::wait() const {
+    if (m_serial || m_fd < 0) {
+        return -1;
+    }
+    if (m_eof ? m_replay.empty() : m_replay.wantsMore()) {
+        return 0;
+    }
+    return m_replay.wait();
+}
+
+int stream::fd() const {
+    return m_fd;
+}
+
+bool stream::isOpen() const {
+    return m_fd >= 0;
+}
+
+bool stream::isSerial() const {
+    return m_serial;
+}
+
+const string& stream::path() const {
+    return m_path;
+}
+
+string stream::name() const {
+    size_t slash = m_path.find_last_of('/');
+    return slash == string::npos ? m_path : m_path.substr(slash + 1);
+}
+
+parser& stream::getParser() {
+    return m_parser;
+}
@@ -0,0 +1,164 @@
+/*
+ * This file is part of XV-11 Parser
+ *
+ * XV-11 Parser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Foobar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include <string>
+#include <fstream>
+#include <sys/types.h>
+#include "parser.h"
+#include "publisher.h"
+#include "recorder.h"
+#include "replay.h"
+
+using std::string;
+
+/*
+ * One robot's input, a serial port or a dump file, together with the parser
+ * decoding it and where that parser's output goes.
+ */
+class stream {
+/* public functions */
+public:
+    /*!
+     * Constructs a stream; nothing is opened until open is called
+     * @param path path to the serial port or dump file
+     * @param serial true if path is a serial port
+     */
+    stream(const char *path, bool serial);
+
+    /*!
+     * Closes the stream
+     */
+    virtual ~stream();
+
+    /*!
+     * Opens the input. Serial ports are set to 115200 8N1 and sent the
+     * activation command.
+     * @return true if successful
+     */
+    bool open();
+
+    /*!
+     * Closes the input
+     */
+    void close();
+
+    /*!
+     * Sends the parser's output to a file instead of stdout
+     * @param filename the file to write to
+     * @return true if successful
+     */
+    bool openLog(const string& filename);
+
+    /*!
+     * Publishes what the parser decodes to other local processes
+     * @param name name of the shared memory and socket, see publisher::open
+     * @return true if successful
+     */
+    bool publish(const string& name);
+
+    /*!
+     * Records the raw input alongside decoding it
+     * @param prefix path prefix of the capture files, see recorder::open
+     * @param rotateSize start a new capture file after this many bytes
+     * @return true if successful
+     */
+    bool record(const string& prefix, uint64_t rotateSize);
+
+    /*!
+     * Paces a dump file by the timestamps in it
+     * @param speed multiple of real time, 0 for as fast as possible
+     */
+    void setSpeed(double speed);
+
+    /*!
+     * Reads whatever is available and feeds it to the recorder, and to the
+     * parser once it is due
+     * @return more than 0 while there is more to come, 0 at end of input,
+     * -1 on error (see errno)
+     */
+    ssize_t pump();
+
+    /*!
+     * Dump files are not polled; instead they say when pump should next be
+     * called
+     * @return nanoseconds until pump should be called, -1 if never (serial
+     * ports, which are polled instead)
+     */
+    int64_t wait() const;
+
+    /*!
+     * @return the file descriptor to poll, -1 if closed
+     */
+    int fd() const;
+
+    /*!
+     * @return true if the input is open
+     */
+    bool isOpen() const;
+
+    /*!
+     * @return true if the input is a serial port
+     */
+    bool isSerial() const;
+
+    /*!
+     * @return the path the stream was constructed with
+     */
+    const string& path() const;
+
+    /*!
+     * @return the file name of the path, used to name per-stream outputs
+     */
+    string name() const;
+
+    /*!
+     * @return the parser decoding this stream
+     */
+    parser& getParser();
+
+/* private functions */
+private:
+    /*!
+     * Configures the serial port and starts packet mode
+     * @return true if successful
+     */
+    bool setupSerial();
+
+    stream(const stream&);
+    stream& operator=(const stream&);
+
+    enum {
+        READ_SIZE = 4096,
+    };
+
+    string m_path;
+    bool m_serial;
+    int m_fd;
+
+    bool m_eof;
+    replay m_replay;
+
+    parser m_parser;
+    std::ofstream m_log;
+    publisher m_publisher;
+    recorder m_recorder;
+};
+
+#endif /* STREAM_H_ */